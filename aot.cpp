@@ -0,0 +1,55 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "memory.hpp"
+#include "cpu.hpp"
+#include "aot.hpp"
+
+AOTImage::AOTImage(const char *image_name, const AOTBlock *image_blocks, size_t count)
+{
+    name = image_name;
+    blocks = image_blocks;
+    size = count;
+    AOT::images().push_back(this);
+}
+
+// registered images (static initializers of generated files)
+std::vector<const AOTImage*> &AOT::images()
+{
+    static std::vector<const AOTImage*> list;
+
+    return (list);
+}
+
+AOT::AOT()
+{
+    AOT::clear();
+}
+
+void AOT::clear()
+{
+    table.fill(nullptr);
+    attached = 0;
+}
+
+bool AOT::attach(const std::string &name)
+{
+    bool found = false;
+
+    for (auto image : AOT::images()){
+        if (name != "all" && name != image->name){
+            continue;
+        }
+        for (size_t i = 0; i < image->size; i++){
+            table[image->blocks[i].addr] = &image->blocks[i];
+        }
+        attached += image->size;
+        found = true;
+        std::cout << "aot " << image->name << "(" << image->size << " blocks)" << std::endl;
+    }
+    if (!found){
+        std::cout << "compiled image not found!(" << name << ")" << std::endl;
+    }
+    return (found);
+}
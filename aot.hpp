@@ -0,0 +1,128 @@
+#ifndef AOT_HPP
+#define AOT_HPP
+
+#include <string>
+#include <vector>
+#include <array>
+#include "common.h"
+#include "memory.hpp"
+#include "cpu.hpp"
+
+//
+// ahead-of-time compiled code (generated by recomp.exe)
+//
+//   A block is straight-line code from addr up to a jump, XPPC or an
+//   instruction left to the interpreter. It adds its micro cycles and
+//   leaves PC at its last byte, as the interpreter would. A store into
+//   the rest of the block ends it there, after the store.
+//
+
+// instructions executed, 0 without side effects when memory no longer holds the compiled code
+typedef UINT32 (*AOTFunc)(CPURegs &reg, Memory &memory, UINT64 &cycles);
+
+// compiled basic block
+struct AOTBlock {
+    WORD addr;              // first instruction (PC + 1)
+    WORD last;              // last byte of the block
+    UINT32 insts;           // instructions in the block
+    UINT32 max_cycles;      // micro cycles, conditional jump taken
+    AOTFunc func;
+};
+
+// blocks of one image, registered by the generated file at startup
+struct AOTImage {
+    AOTImage(const char *image_name, const AOTBlock *image_blocks, size_t count);
+
+    const char *name;
+    const AOTBlock *blocks;
+    size_t size;
+};
+
+// compiled blocks attached to CPU (shared by machines, hits counted by CPU)
+class AOT {
+public:
+    AOT();
+
+    bool attach(const std::string &name);       // "all": every registered image
+    void clear();
+    inline bool empty() const {return (attached == 0);};
+    static std::vector<const AOTImage*> &images();
+
+    // block at PC + 1 (nullptr: interpret)
+    inline const AOTBlock *find(WORD addr) const {return (table[addr]);};
+
+private:
+    std::array<const AOTBlock*, 64 * 1024> table;
+    size_t attached;
+};
+
+//
+// helpers of generated code, same semantics as CPU
+//
+
+// address in the page of base (CPU::calc_ea)
+inline WORD aot_ea(WORD base, int disp)
+{
+    return ((base & BIT_PR_PAGE) | ((base + disp) & ~BIT_PR_PAGE));
+}
+
+// auto-indexed addressing (CPU::get_ea)
+inline WORD aot_auto(WORD &pr, SBYTE disp)
+{
+    WORD ea = pr;
+
+    if (disp < 0){
+        ea = aot_ea(pr, disp);
+        pr = ea;
+    }
+    else {
+        pr = aot_ea(pr, disp);
+    }
+    return (ea);
+}
+
+// CPU::add_byte
+inline BYTE aot_add(BYTE &sr, BYTE a, BYTE b)
+{
+    WORD c = (WORD)a + (WORD)b + ((sr & BIT_SR_CY) == 0 ? 0: 1);
+
+    sr = (sr & ~(BIT_SR_CY | BIT_SR_OV)) | ((c & 0x0100) >> 1);
+    if (((a & BIT_SIGN_BYTE) == (b & BIT_SIGN_BYTE)) && ((a & BIT_SIGN_BYTE) != (c & BIT_SIGN_BYTE))){
+        sr |= BIT_SR_OV;
+    }
+    return ((BYTE)c);
+}
+
+// CPU::add_bcd
+inline BYTE aot_bcd(BYTE &sr, BYTE a, BYTE b)
+{
+    WORD c = (WORD)a + (WORD)b + ((sr & BIT_SR_CY) == 0 ? 0: 1);
+
+    if (c % 16 >= 0x0a){
+        c += 6;
+    }
+    if (c >= 0xa0){
+        c += 0x60;
+    }
+    sr = (sr & ~BIT_SR_CY) | ((c & 0x0100) >> 1);
+    return ((BYTE)c);
+}
+
+// store of the block into its code from first to last
+inline bool aot_inside(WORD ea, WORD first, WORD last)
+{
+    return (first <= ea && ea <= last);
+}
+
+// memory still holds the compiled code
+inline bool aot_same(Memory &memory, WORD addr, const BYTE *code, int length)
+{
+    for (int i = 0; i < length; i++){
+        if (memory.fetch(addr + i) != code[i]){
+            return (false);
+        }
+    }
+    return (true);
+}
+
+#endif
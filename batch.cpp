@@ -0,0 +1,517 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "common.h"
+#include "memory.hpp"
+#include "io.hpp"
+#include "cpu.hpp"
+#include "aot.hpp"
+#include "batch.hpp"
+
+// AVX2 code for hosts that have it, selected at load time
+#define BATCH_CLONES __attribute__((target_clones("avx2", "default")))
+
+// micro cycles of a vector step at most (conditional jump taken)
+const UINT64 BATCH_STEP_CYCLES = 23 + 2;
+
+Batch::Batch(size_t count)
+{
+    for (size_t n = 0; n < count; n++){
+        lanes.emplace_back(new BatchLane());
+        lanes.back()->status = SUCCESS;
+        memories.push_back(&lanes.back()->memory);
+    }
+    padded = (count + BATCH_BLOCK - 1) / BATCH_BLOCK * BATCH_BLOCK;
+
+    ac.assign(padded, 0);
+    er.assign(padded, 0);
+    sr.assign(padded, 0);
+    for (auto &p : pr){
+        p.assign(padded, 0);
+    }
+    insts.assign(padded, 0);
+    cycles.assign(padded, 0);
+    active.assign(padded, 0);
+    mask.assign(padded, 0);
+    ea.assign(padded, 0);
+    data.assign(padded, 0);
+    pages.assign(padded, nullptr);
+    page_number = -1;
+
+    steps = vector_insts = scalar_insts = 0;
+}
+
+// image is loaded once, the other lanes share its pages
+bool Batch::load(const std::string &filename)
+{
+    if (lanes.empty() || !lanes[0]->memory.load(filename)){
+        return (false);
+    }
+    for (size_t n = 1; n < lanes.size(); n++){
+        lanes[n]->memory = lanes[0]->memory;
+    }
+    return (true);
+}
+
+void Batch::gather(size_t n)
+{
+    CPU &cpu = lanes[n]->cpu;
+
+    ac[n] = cpu.getAC();
+    er[n] = cpu.getER();
+    sr[n] = cpu.getSR();
+    pr[0][n] = cpu.getPC();
+    pr[1][n] = cpu.getP1();
+    pr[2][n] = cpu.getP2();
+    pr[3][n] = cpu.getP3();
+}
+
+void Batch::scatter(size_t n)
+{
+    CPU &cpu = lanes[n]->cpu;
+
+    cpu.setAC(ac[n]);
+    cpu.setER(er[n]);
+    cpu.setSR(sr[n]);
+    cpu.setPC(pr[0][n]);
+    cpu.setP1(pr[1][n]);
+    cpu.setP2(pr[2][n]);
+    cpu.setP3(pr[3][n]);
+}
+
+void Batch::scalar(size_t n)
+{
+    CPU &cpu = lanes[n]->cpu;
+    UINT64 start_insts = cpu.get_insts();
+    UINT64 start_cycles = cpu.get_cycles();
+
+    Batch::scatter(n);
+    CPUSTAT stat = cpu.clock();
+    Batch::gather(n);
+
+    Batch::refresh(n, page_number << MEMORY_PAGE_SHIFT);
+    insts[n] += cpu.get_insts() - start_insts;
+    cycles[n] += cpu.get_cycles() - start_cycles;
+    scalar_insts += cpu.get_insts() - start_insts;
+    if (stat == HALT || stat == UNDEFINED || stat == WAIT_INPUT){
+        lanes[n]->status = stat;
+        active[n] = 0;
+    }
+}
+
+// instructions of the vector loops (the rest is rare or has side effects)
+static bool vectorizable(BYTE opcode)
+{
+    if (CPU::cycle_table[opcode] == 0){
+        return (false);             // undefined
+    }
+    switch (opcode){
+    case OPE_HALT:
+    case OPE_IEN:
+    case OPE_CAS:
+    case OPE_DLY:
+    case OPE_PUTC:
+    case OPE_GETC:
+    case OPE_XPAL:                  // P0: PC is changed
+    case OPE_XPAH:
+    case OPE_XPPC:
+        return (false);
+    }
+    return (true);
+}
+
+void Batch::run(UINT64 insts_limit, UINT64 cycles_limit)
+{
+    size_t count = lanes.size();
+
+    running.clear();
+    page_number = -1;
+    for (size_t n = 0; n < count; n++){
+        Batch::gather(n);
+        insts[n] = lanes[n]->cpu.get_insts();
+        cycles[n] = lanes[n]->cpu.get_cycles();
+        lanes[n]->status = SUCCESS;
+        active[n] = 1;
+        running.push_back(n);
+    }
+
+    UINT64 safe = 0;
+    while (1){
+        if (safe == 0){
+            safe = Batch::headroom(insts_limit, cycles_limit);
+        }
+        safe--;
+
+        UINT32 addr = Batch::select();
+        if (addr > 0xffff){
+            break;                  // every lane stopped
+        }
+        steps++;
+
+        if ((int)(addr >> MEMORY_PAGE_SHIFT) != page_number){
+            page_number = addr >> MEMORY_PAGE_SHIFT;
+            for (auto n : running){
+                pages[n] = memories[n]->peek_page(addr);
+            }
+        }
+
+        // lanes there with the same instruction (code may differ by lane, not in a shared page)
+        const BYTE *code = nullptr;
+        WORD op_offset = addr & (MEMORY_PAGE_SIZE - 1);
+        WORD disp_offset = aot_ea(addr, 1) & (MEMORY_PAGE_SIZE - 1);
+        BYTE opcode = 0;
+        SBYTE disp = 0;
+        bool fit = false;
+        UINT64 selected = 0;
+
+        deferred.clear();
+        for (auto n : running){
+            if (mask[n] == 0){
+                continue;
+            }
+            const BYTE *lane_code = pages[n];
+            if (code == nullptr){
+                code = lane_code;
+                opcode = code[op_offset];
+                disp = ((opcode & BIT_SIGN_BYTE) != 0) ? code[disp_offset] : 0;
+                fit = vectorizable(opcode);
+            }
+            bool same = (lane_code == code) ||
+                        (lane_code[op_offset] == opcode && ((opcode & BIT_SIGN_BYTE) == 0 || (SBYTE)lane_code[disp_offset] == disp));
+            if (mask[n] != 1 || !same || !fit){
+                mask[n] = 0;
+                deferred.push_back(n);
+                continue;
+            }
+            selected++;
+        }
+
+        if (selected > 0){
+            Batch::vector(addr, opcode, disp);
+            vector_insts += selected;
+        }
+        for (auto n : deferred){
+            Batch::scalar(n);
+            safe = 0;               // cycles may grow more than a step (DLY, interrupt)
+        }
+        if (!deferred.empty()){
+            Batch::compact();
+        }
+    }
+
+    for (size_t n = 0; n < count; n++){
+        CPU &cpu = lanes[n]->cpu;
+
+        Batch::scatter(n);
+        cpu.advance(insts[n] - cpu.get_insts(), cycles[n] - cpu.get_cycles());
+    }
+}
+
+// a write replaces a shared page by a private copy
+void Batch::refresh(size_t n, WORD addr)
+{
+    if ((int)(addr >> MEMORY_PAGE_SHIFT) == page_number){
+        pages[n] = memories[n]->peek_page(addr);
+    }
+}
+
+void Batch::compact()
+{
+    running.erase(std::remove_if(running.begin(), running.end(), [this](UINT32 n){return (active[n] == 0);}), running.end());
+}
+
+// lanes at a limit stop, steps that the others can run before a limit (0: none)
+UINT64 Batch::headroom(UINT64 insts_limit, UINT64 cycles_limit)
+{
+    UINT64 room = 0;
+    bool stopped = false;
+
+    for (auto n : running){
+        if (insts[n] >= insts_limit || cycles[n] >= cycles_limit){
+            lanes[n]->status = BUDGET;
+            active[n] = 0;
+            stopped = true;
+            continue;
+        }
+        // a vector step adds 1 instruction and up to BATCH_STEP_CYCLES
+        UINT64 lane_steps = insts_limit - insts[n];
+        if (lane_steps > (cycles_limit - cycles[n]) / BATCH_STEP_CYCLES){
+            lane_steps = (cycles_limit - cycles[n]) / BATCH_STEP_CYCLES;
+        }
+        if (room == 0 || lane_steps < room){
+            room = (lane_steps == 0) ? 1 : lane_steps;
+        }
+    }
+    if (stopped){
+        Batch::compact();
+    }
+    return (room);
+}
+
+// lowest PC + 1 of the running lanes (0x10000: none)
+// mask: lanes there (2: interrupt is pending)
+BATCH_CLONES
+UINT32 Batch::select()
+{
+    const BYTE *__restrict act = active.data();
+    BYTE *__restrict m = mask.data();
+    const BYTE *__restrict s = sr.data();
+    const WORD *__restrict pc = pr[0].data();
+    size_t count = padded;
+    UINT32 addr = 0x10000;
+
+    for (size_t b = 0; b < count; b += BATCH_BLOCK){
+        for (size_t i = b; i < b + BATCH_BLOCK; i++){
+            UINT32 next = act[i] ? (pc[i] & BIT_PR_PAGE) | ((pc[i] + 1) & ~BIT_PR_PAGE) : 0x10000;
+            addr = (next < addr) ? next : addr;
+        }
+    }
+
+    for (size_t b = 0; b < count; b += BATCH_BLOCK){
+        for (size_t i = b; i < b + BATCH_BLOCK; i++){
+            UINT32 next = (pc[i] & BIT_PR_PAGE) | ((pc[i] + 1) & ~BIT_PR_PAGE);
+            BYTE pending = ((s[i] & (BIT_SR_IE | BIT_SR_SA)) == (BIT_SR_IE | BIT_SR_SA));
+            m[i] = (act[i] && next == addr) ? 1 + pending : 0;
+        }
+    }
+    return (addr);
+}
+
+//
+// vector loops: lanes in blocks of BATCH_BLOCK, registers of the lanes out
+// of the mask are kept by a select (no branch in the loop)
+//
+
+// AC, ER and SR by f(ac, er, sr, lane)
+template <typename F>
+static inline void lanes_reg(size_t count, const BYTE *__restrict m, BYTE *__restrict a, BYTE *__restrict e, BYTE *__restrict s, F f)
+{
+    for (size_t b = 0; b < count; b += BATCH_BLOCK){
+        for (size_t i = b; i < b + BATCH_BLOCK; i++){
+            BYTE ra = a[i], re = e[i], rs = s[i];
+            f(ra, re, rs, i);
+            a[i] = m[i] ? ra : a[i];
+            e[i] = m[i] ? re : e[i];
+            s[i] = m[i] ? rs : s[i];
+        }
+    }
+}
+
+// AC and pointer by f(ac, pr, pc)
+template <typename F>
+static inline void lanes_ptr(size_t count, const BYTE *__restrict m, BYTE *__restrict a, WORD *__restrict p, WORD *__restrict pc, F f)
+{
+    for (size_t b = 0; b < count; b += BATCH_BLOCK){
+        for (size_t i = b; i < b + BATCH_BLOCK; i++){
+            BYTE ra = a[i];
+            WORD rp = p[i], rpc = pc[i];
+            f(ra, rp, rpc);
+            a[i] = m[i] ? ra : a[i];
+            p[i] = m[i] ? rp : p[i];
+            pc[i] = m[i] ? rpc : pc[i];
+        }
+    }
+}
+
+// effective address of memory reference instructions (CPU::get_ea)
+BATCH_CLONES
+void Batch::calc_ea(BYTE opcode, SBYTE disp)
+{
+    const BYTE *__restrict m = mask.data();
+    const BYTE *__restrict e = er.data();
+    WORD *__restrict p = pr[opcode & BIT_OPCODE_PR].data();
+    WORD *__restrict a = ea.data();
+    bool use_er = (disp == -128 && opcode >= OPE_LD);       // not ILD, DLD
+    size_t count = padded;
+
+    for (size_t b = 0; b < count; b += BATCH_BLOCK){
+        for (size_t i = b; i < b + BATCH_BLOCK; i++){
+            SBYTE d = use_er ? (SBYTE)e[i] : disp;
+            WORD next = (p[i] & BIT_PR_PAGE) | ((p[i] + d) & ~BIT_PR_PAGE);
+            if ((opcode & BIT_OPCODE_MODE) == 0 || opcode < OPE_LD){   // indexed
+                a[i] = next;
+            }
+            else {                                                  // auto-indexed
+                a[i] = (d < 0) ? next : p[i];
+                p[i] = m[i] ? next : p[i];
+            }
+        }
+    }
+}
+
+//
+// one instruction at addr for the lanes in mask (CPU::clock)
+//
+BATCH_CLONES
+void Batch::vector(WORD addr, BYTE opcode, SBYTE disp)
+{
+    const BYTE *__restrict m = mask.data();
+    BYTE *a = ac.data();
+    BYTE *e = er.data();
+    BYTE *s = sr.data();
+    BYTE *__restrict d = data.data();
+    WORD *pc = pr[0].data();
+    WORD *p = pr[opcode & BIT_OPCODE_PR].data();
+    UINT64 *__restrict in = insts.data();
+    UINT64 *__restrict cy = cycles.data();
+    BYTE cycle = CPU::cycle_table[opcode];
+    WORD next = aot_ea(addr, ((opcode & BIT_SIGN_BYTE) != 0) ? 1 : 0);      // PC after fetch
+    size_t count = padded;      // lanes of padding are out of mask
+
+    for (size_t b = 0; b < count; b += BATCH_BLOCK){
+        for (size_t i = b; i < b + BATCH_BLOCK; i++){
+            pc[i] = m[i] ? next : pc[i];
+            in[i] += m[i];
+            cy[i] += m[i] ? cycle : 0;
+        }
+    }
+
+    if ((opcode & BIT_SIGN_BYTE) == 0){
+        switch (opcode & ((OPE_XPAL <= opcode && opcode <= OPE_XPPC + 3) ? ~BIT_OPCODE_PR : 0xff)){
+        case OPE_XAE:
+            lanes_reg(count, m, a, e, s, [](BYTE &a, BYTE &e, BYTE &s, size_t){BYTE t = a; a = e; e = t;});
+            break;
+        case OPE_CCL:
+            lanes_reg(count, m, a, e, s, [](BYTE &a, BYTE &e, BYTE &s, size_t){s &= ~BIT_SR_CY;});
+            break;
+        case OPE_SCL:
+            lanes_reg(count, m, a, e, s, [](BYTE &a, BYTE &e, BYTE &s, size_t){s |= BIT_SR_CY;});
+            break;
+        case OPE_DINT:
+            lanes_reg(count, m, a, e, s, [](BYTE &a, BYTE &e, BYTE &s, size_t){s &= ~BIT_SR_IE;});
+            break;
+        case OPE_CSA:
+            lanes_reg(count, m, a, e, s, [](BYTE &a, BYTE &e, BYTE &s, size_t){a = s;});
+            break;
+        case OPE_SIO:
+            lanes_reg(count, m, a, e, s, [](BYTE &a, BYTE &e, BYTE &s, size_t){e >>= 1;});
+            break;
+        case OPE_SR:
+            lanes_reg(count, m, a, e, s, [](BYTE &a, BYTE &e, BYTE &s, size_t){a >>= 1;});
+            break;
+        case OPE_SRL:
+            lanes_reg(count, m, a, e, s, [](BYTE &a, BYTE &e, BYTE &s, size_t){a = (a >> 1) | (s & BIT_SR_CY);});
+            break;
+        case OPE_RR:
+            lanes_reg(count, m, a, e, s, [](BYTE &a, BYTE &e, BYTE &s, size_t){a = (a >> 1) | (a << 7);});
+            break;
+        case OPE_RRL:
+            lanes_reg(count, m, a, e, s, [](BYTE &a, BYTE &e, BYTE &s, size_t){
+                BYTE lsb = a & 1;
+                a = (a >> 1) | (s & BIT_SR_CY);
+                s = (s & ~BIT_SR_CY) | (lsb << 7);
+            });
+            break;
+        case OPE_XPAL:
+            lanes_ptr(count, m, a, p, pc, [](BYTE &a, WORD &p, WORD &pc){BYTE t = a; a = p; p = (p & 0xff00) | t;});
+            break;
+        case OPE_XPAH:
+            lanes_ptr(count, m, a, p, pc, [](BYTE &a, WORD &p, WORD &pc){BYTE t = a; a = p >> 8; p = (p & 0x00ff) | (t << 8);});
+            break;
+        case OPE_XPPC:
+            lanes_ptr(count, m, a, p, pc, [](BYTE &a, WORD &p, WORD &pc){WORD t = pc; pc = p; p = t;});
+            break;
+        case OPE_LDE:
+            lanes_reg(count, m, a, e, s, [](BYTE &a, BYTE &e, BYTE &s, size_t){a = e;});
+            break;
+        case OPE_ANE:
+            lanes_reg(count, m, a, e, s, [](BYTE &a, BYTE &e, BYTE &s, size_t){a &= e;});
+            break;
+        case OPE_ORE:
+            lanes_reg(count, m, a, e, s, [](BYTE &a, BYTE &e, BYTE &s, size_t){a |= e;});
+            break;
+        case OPE_XRE:
+            lanes_reg(count, m, a, e, s, [](BYTE &a, BYTE &e, BYTE &s, size_t){a ^= e;});
+            break;
+        case OPE_DAE:
+            lanes_reg(count, m, a, e, s, [](BYTE &a, BYTE &e, BYTE &s, size_t){a = aot_bcd(s, a, e);});
+            break;
+        case OPE_ADE:
+            lanes_reg(count, m, a, e, s, [](BYTE &a, BYTE &e, BYTE &s, size_t){a = aot_add(s, a, e);});
+            break;
+        case OPE_CAE:
+            lanes_reg(count, m, a, e, s, [](BYTE &a, BYTE &e, BYTE &s, size_t){a = aot_add(s, a, ~e);});
+            break;
+        }
+        return;
+    }
+
+    if (OPE_JMP <= opcode && opcode <= OPE_JNZ + 3){               // JMP, JP, JZ, JNZ
+        int inst = opcode & 0xfc;
+        for (size_t b = 0; b < count; b += BATCH_BLOCK){
+            for (size_t i = b; i < b + BATCH_BLOCK; i++){
+                bool taken = m[i] && ((inst == OPE_JMP) || (inst == OPE_JP && (a[i] & BIT_SIGN_BYTE) == 0) ||
+                             (inst == OPE_JZ && a[i] == 0) || (inst == OPE_JNZ && a[i] != 0));
+                WORD target = (p[i] & BIT_PR_PAGE) | ((p[i] + disp) & ~BIT_PR_PAGE);
+                pc[i] = taken ? target : pc[i];
+                cy[i] += (taken && inst != OPE_JMP) ? 2 : 0;    // jump taken
+            }
+        }
+        return;
+    }
+
+    // memory reference: address by vector loop, data lane by lane
+    int inst = (opcode >= OPE_LD) ? (opcode & 0xf8) : (opcode & 0xfc);
+
+    if (opcode >= OPE_LD && (opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR)) == 4){    // immediate
+        for (size_t i = 0; i < count; i++){
+            d[i] = disp;
+        }
+    }
+    else {
+        Batch::calc_ea(opcode, disp);
+        for (auto i : running){
+            if (m[i] && inst != OPE_ST){
+                d[i] = ((int)(ea[i] >> MEMORY_PAGE_SHIFT) == page_number) ? pages[i][ea[i] & (MEMORY_PAGE_SIZE - 1)] : memories[i]->peek(ea[i]);
+            }
+        }
+    }
+
+    switch (inst){
+    case OPE_ST:
+        for (auto i : running){
+            if (m[i]){
+                memories[i]->write(ea[i], a[i]);
+                Batch::refresh(i, ea[i]);
+            }
+        }
+        break;
+    case OPE_ILD:
+        lanes_reg(count, m, a, e, s, [d](BYTE &a, BYTE &e, BYTE &s, size_t i){a = d[i] + 1;});
+        break;
+    case OPE_DLD:
+        lanes_reg(count, m, a, e, s, [d](BYTE &a, BYTE &e, BYTE &s, size_t i){a = d[i] - 1;});
+        break;
+    case OPE_LD:
+        lanes_reg(count, m, a, e, s, [d](BYTE &a, BYTE &e, BYTE &s, size_t i){a = d[i];});
+        break;
+    case OPE_AND:
+        lanes_reg(count, m, a, e, s, [d](BYTE &a, BYTE &e, BYTE &s, size_t i){a &= d[i];});
+        break;
+    case OPE_OR:
+        lanes_reg(count, m, a, e, s, [d](BYTE &a, BYTE &e, BYTE &s, size_t i){a |= d[i];});
+        break;
+    case OPE_XOR:
+        lanes_reg(count, m, a, e, s, [d](BYTE &a, BYTE &e, BYTE &s, size_t i){a ^= d[i];});
+        break;
+    case OPE_DAD:
+        lanes_reg(count, m, a, e, s, [d](BYTE &a, BYTE &e, BYTE &s, size_t i){a = aot_bcd(s, a, d[i]);});
+        break;
+    case OPE_ADD:
+        lanes_reg(count, m, a, e, s, [d](BYTE &a, BYTE &e, BYTE &s, size_t i){a = aot_add(s, a, d[i]);});
+        break;
+    case OPE_CAD:
+        lanes_reg(count, m, a, e, s, [d](BYTE &a, BYTE &e, BYTE &s, size_t i){a = aot_add(s, a, ~d[i]);});
+        break;
+    }
+
+    if (inst == OPE_ILD || inst == OPE_DLD){
+        for (auto i : running){
+            if (m[i]){
+                memories[i]->write(ea[i], a[i]);
+                Batch::refresh(i, ea[i]);
+            }
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "common.h"
+#include "memory.hpp"
+#include "io.hpp"
+#include "cpu.hpp"
+
+//
+// lockstep execution of many instances of one image (parameter sweeps)
+//
+//   Registers of the lanes are kept in arrays (structure of arrays). Each
+//   step executes the instruction at the lowest PC + 1 for every lane that
+//   is there, as loops over all lanes under a mask, which the compiler
+//   turns into vector code (AVX2 when the host has it). Lanes at another
+//   PC wait, so lanes that took different branches re-converge where the
+//   paths join. Memory is accessed lane by lane, through the list of
+//   running lanes and a pointer to the page of the step in each lane.
+//   Lanes that share that page (loaded once, not written) share the
+//   instruction, which is then read once per step.
+//   Interrupts, I/O, HALT, DLY and the other rare instructions are
+//   executed by the CPU of the lane.
+//
+
+// lanes per vector loop (arrays are padded to a multiple)
+const size_t BATCH_BLOCK = 32;
+
+// lanes of a batch (each has its own memory and CPU)
+const size_t BATCH_MAX_LANES = 4096;
+
+// one SC/MP instance of a batch
+struct BatchLane {
+    BatchLane(): cpu(memory){cpu.set_io(&io, &io);};
+
+    Memory memory;          // not watched (read by peek())
+    StringChannel io;       // GETC input, PUTC output
+    CPU cpu;                // registers are up to date outside Batch::run()
+    CPUSTAT status;         // why the lane stopped in the last run()
+};
+
+class Batch {
+public:
+    Batch(size_t lanes);
+
+    bool load(const std::string &filename);     // into every lane
+
+    inline size_t size(){return (lanes.size());};
+    inline CPU &cpu(size_t n){return (lanes[n]->cpu);};
+    inline Memory &memory(size_t n){return (lanes[n]->memory);};
+    inline StringChannel &io(size_t n){return (lanes[n]->io);};
+    inline CPUSTAT status(size_t n){return (lanes[n]->status);};
+
+    // run until every lane stops (limits are absolute as CPU::run(), BUDGET: limit reached)
+    void run(UINT64 insts_limit, UINT64 cycles_limit);
+
+    // steps of run(), instructions executed by vector loops and by the CPU of a lane
+    inline UINT64 get_steps(){return (steps);};
+    inline UINT64 get_vector_insts(){return (vector_insts);};
+    inline UINT64 get_scalar_insts(){return (scalar_insts);};
+
+private:
+    std::vector<std::unique_ptr<BatchLane>> lanes;
+    std::vector<Memory*> memories;      // memory of each lane
+    size_t padded;              // lanes rounded up to BATCH_BLOCK
+
+    // registers and counters of the lanes
+    std::vector<BYTE> ac, er, sr;
+    std::vector<WORD> pr[4];
+    std::vector<UINT64> insts, cycles;
+
+    std::vector<BYTE> active;   // lane is running
+    std::vector<UINT32> running;    // lanes running, in order (compacted when lanes stop)
+    std::vector<BYTE> mask;     // lane executes the vector step
+    std::vector<WORD> ea;       // effective address of the vector step
+    std::vector<BYTE> data;     // memory operand of the vector step
+    std::vector<size_t> deferred;   // lanes at the PC of the step left to their CPU
+    std::vector<const BYTE*> pages;     // page of the step in the memory of each lane (Memory::peek_page)
+    int page_number;            // of pages (-1: none)
+
+    UINT64 steps;
+    UINT64 vector_insts;
+    UINT64 scalar_insts;
+
+    void gather(size_t n);      // CPU of lane n -> arrays
+    void scatter(size_t n);     // arrays -> CPU of lane n
+    void scalar(size_t n);      // one instruction by the CPU of lane n
+    void compact();             // stopped lanes out of running
+    void refresh(size_t n, WORD addr);      // pages[n] after lane n wrote to addr
+    UINT64 headroom(UINT64 insts_limit, UINT64 cycles_limit);
+    UINT32 select();
+    void vector(WORD addr, BYTE opcode, SBYTE disp);    // instruction at addr for lanes in mask
+    void calc_ea(BYTE opcode, SBYTE disp);
+};
+
+#endif
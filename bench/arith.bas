@@ -0,0 +1,7 @@
+10 S=0
+20 FOR I=1 TO 5000
+30 S=S+I*3-I/2
+40 NEXT I
+50 PRINT S
+60 END
+RUN
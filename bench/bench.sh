@@ -0,0 +1,114 @@
+#!/bin/sh
+#
+# emulator throughput benchmark (make bench)
+#
+#   sh bench/bench.sh [-r repeat] [-o result.json] [-b baseline.json] [-t tolerance%]
+#
+# Every workload runs headless with fixed input and reports instructions
+# and micro cycles per second of the best of <repeat> runs, as JSON.
+# With -b, each workload is compared with the baseline result and the
+# script fails when one is slower by more than <tolerance> percent.
+#
+# S-record workloads (code from 0001, end with HALT):
+#   autoidx  block copy with LD @1(P1) / ST @1(P2), LD @-128(P1) (disp = ER)
+#   dad      3-byte BCD counter with DAI / DAD
+#   xppc     two-level call chain XPPC P3 -> XPPC P2
+#   mul      8x8 bit shift-and-add multiply subroutine, all operand pairs
+#   mul_hle  mul with the subroutine trapped to native code (mul.hle)
+# NIBL workloads (need the NIBL image, NIBL=path overrides nibl.srec):
+#   sieve    prime sieve on @ memory
+#   arith    loop with multiply / divide
+#   print    PRINT of a string and a number
+
+EXE=./scmp2.exe
+DIR=bench
+NIBL=${NIBL:-nibl.srec}
+REPEAT=3
+OUTPUT=
+BASELINE=
+TOLERANCE=5
+
+while getopts "r:o:b:t:" opt; do
+    case $opt in
+    r) REPEAT=$OPTARG ;;
+    o) OUTPUT=$OPTARG ;;
+    b) BASELINE=$OPTARG ;;
+    t) TOLERANCE=$OPTARG ;;
+    *) echo "usage: bench.sh [-r repeat] [-o result.json] [-b baseline.json] [-t tolerance%]" >&2; exit 1 ;;
+    esac
+done
+
+RESULT=$(mktemp)
+trap 'rm -f "$RESULT"' EXIT
+
+# run NAME ARGS... : best of REPEAT runs, one JSON object per line to RESULT
+run() {
+    name=$1
+    shift
+    best=
+    i=0
+    while [ $i -lt "$REPEAT" ]; do
+        summary=$($EXE -s -t 120 -o /dev/null "$@" 2>&1 >/dev/null | grep '^status=')
+        time=$(echo "$summary" | sed -n 's/.* run_time=\([^ ]*\).*/\1/p')
+        if [ -z "$best" ] || awk "BEGIN{exit !($time < $best_time)}"; then
+            best=$summary
+            best_time=$time
+        fi
+        i=$((i + 1))
+    done
+    echo "$best" | awk -v name="$name" '{
+        for (i = 1; i <= NF; i++){
+            split($i, kv, "=");
+            v[kv[1]] = kv[2];
+        }
+        t = (v["run_time"] > 0) ? v["run_time"] : 1e-9;
+        printf("{\"name\": \"%s\", \"status\": \"%s\", \"insts\": %s, \"cycles\": %s, \"seconds\": %s, \"ips\": %.0f, \"cps\": %.0f}\n",
+               name, v["status"], v["insts"], v["cycles"], v["run_time"], v["insts"] / t, v["cycles"] / t);
+    }' >> "$RESULT"
+    echo "$name: $best" >&2
+}
+
+run autoidx "$DIR/autoidx.srec"
+run dad "$DIR/dad.srec"
+run xppc "$DIR/xppc.srec"
+run mul "$DIR/mul.srec"
+run mul_hle --hle "$DIR/mul.hle" "$DIR/mul.srec"
+
+if [ -f "$NIBL" ]; then
+    for prog in sieve arith print; do
+        run $prog -l "$NIBL" --sb -b "$DIR/$prog.bas" -I ""
+    done
+else
+    echo "$NIBL not found: NIBL workloads skipped" >&2
+fi
+
+json=$(awk 'BEGIN{print "{"; print "  \"workloads\": ["}
+            {if (NR > 1) printf(",\n"); printf("    %s", $0)}
+            END{print ""; print "  ]"; print "}"}' "$RESULT")
+echo "$json"
+if [ -n "$OUTPUT" ]; then
+    echo "$json" > "$OUTPUT"
+fi
+
+# compare ips with baseline
+if [ -n "$BASELINE" ]; then
+    status=0
+    while read -r line; do
+        name=$(echo "$line" | sed -n 's/.*"name": "\([^"]*\)".*/\1/p')
+        ips=$(echo "$line" | sed -n 's/.*"ips": \([0-9]*\).*/\1/p')
+        base=$(grep "\"name\": \"$name\"" "$BASELINE" | sed -n 's/.*"ips": \([0-9]*\).*/\1/p')
+        if [ -z "$base" ]; then
+            echo "$name: no baseline" >&2
+            continue
+        fi
+        verdict=$(awk -v ips="$ips" -v base="$base" -v tol="$TOLERANCE" 'BEGIN{
+            r = ips / base;
+            printf("%.3f %s", r, (r < 1 - tol / 100) ? "REGRESSION" : "ok");
+        }')
+        echo "$name: $ips ips / baseline $base = $verdict" >&2
+        case $verdict in
+        *REGRESSION) status=1 ;;
+        esac
+    done < "$RESULT"
+    exit $status
+fi
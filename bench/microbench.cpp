@@ -0,0 +1,319 @@
+//
+// component microbenchmark (make microbench)
+//
+//   microbench.exe [-s samples] [-j] [filter]
+//
+// Each benchmark is timed in samples of a calibrated number of operations
+// (about 10 ms each) and reported as ns/op: min, median, mean, stddev.
+//
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "../common.h"
+#include "../util.hpp"
+#include "../memory.hpp"
+#include "../io.hpp"
+#include "../cpu.hpp"
+#include "../machine.hpp"
+#include "../disasm.hpp"
+
+// result of a benchmark (ns/op)
+struct Stat {
+    std::string name;
+    double min;
+    double median;
+    double mean;
+    double stddev;
+};
+
+static volatile UINT32 sink;       // keeps results alive
+
+// access to private members of CPU
+class MicroBench {
+public:
+    MicroBench(Machine &machine): machine(machine), cpu(machine.cpu){};
+
+    inline BYTE fetch(){return (cpu.fetch());};
+    inline WORD calc_ea(int pr, SBYTE disp){return (cpu.calc_ea(pr, disp));};
+    inline WORD get_ea(int addressing, SBYTE disp){return (cpu.get_ea(addressing, disp));};
+    inline SBYTE get_data(int addressing, SBYTE disp){return (cpu.get_data(addressing, disp));};
+    inline BYTE add_byte(BYTE a, BYTE b){return (cpu.add_byte(a, b));};
+    inline BYTE add_bcd(BYTE a, BYTE b){return (cpu.add_bcd(a, b));};
+
+private:
+    Machine &machine;
+    CPU &cpu;
+};
+
+static Stat measure(const std::string &name, int samples, const std::function<void(UINT32)> &body)
+{
+    using clock = std::chrono::steady_clock;
+    UINT32 ops = 1;
+    std::vector<double> result;
+
+    // calibrate: about 10 ms per sample
+    while (1){
+        auto start = clock::now();
+        body(ops);
+        std::chrono::duration<double> elapsed = clock::now() - start;
+        if (elapsed.count() >= 0.01 || ops >= (1U << 30)){
+            break;
+        }
+        ops *= 2;
+    }
+
+    for (int i = 0; i < samples; i++){
+        auto start = clock::now();
+        body(ops);
+        std::chrono::duration<double, std::nano> elapsed = clock::now() - start;
+        result.push_back(elapsed.count() / ops);
+    }
+
+    std::sort(result.begin(), result.end());
+    double sum = 0, sq = 0;
+    for (double ns : result){
+        sum += ns;
+    }
+    double mean = sum / samples;
+    for (double ns : result){
+        sq += (ns - mean) * (ns - mean);
+    }
+
+    Stat stat;
+    stat.name = name;
+    stat.min = result.front();
+    stat.median = (samples % 2) ? result[samples / 2] : (result[samples / 2 - 1] + result[samples / 2]) / 2;
+    stat.mean = mean;
+    stat.stddev = std::sqrt(sq / samples);
+
+    return (stat);
+}
+
+int main(int argc, char* argv[])
+{
+    Machine machine;
+    CPU &cpu = machine.cpu;
+    Memory &memory = machine.memory;
+    Disasm disasm(memory, cpu);
+    MicroBench mb(machine);
+    int samples = 15;
+    bool json = false;
+    std::string filter;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:j")) != -1){
+        switch (opt){
+        case 's': samples = std::max(1, atoi(optarg)); break;
+        case 'j': json = true; break;
+        default:
+            std::cerr << "usage: microbench.exe [-s samples] [-j] [filter]" << std::endl;
+            return (1);
+        }
+    }
+    if (optind < argc){
+        filter = argv[optind];
+    }
+
+    // every opcode and displacement in memory for fetch and unasm
+    for (int addr = 0; addr <= 0xffff; addr++){
+        memory.write(addr, (BYTE)(addr * 7 + (addr >> 8)));
+    }
+    cpu.setP1(0x1800);
+    cpu.setP2(0x2800);
+    cpu.setP3(0x3800);
+    cpu.setER(0x10);
+
+    // S-record of the whole 64 KB for Memory::load
+    char srec[] = "/tmp/microbenchXXXXXX";
+    int fd = mkstemp(srec);
+    if (fd < 0){
+        std::cerr << "mkstemp failed" << std::endl;
+        return (1);
+    }
+    close(fd);
+    std::stringstream discard;
+    std::streambuf *cout_buf = std::cout.rdbuf(discard.rdbuf());
+    memory.save(srec, 0, 0xffff);
+    std::cout.rdbuf(cout_buf);
+
+    std::vector<std::pair<std::string, std::function<void(UINT32)> > > benches = {
+        {"CPU::fetch", [&](UINT32 n){
+            UINT32 sum = 0;
+            for (UINT32 i = 0; i < n; i++){
+                sum += mb.fetch();
+            }
+            sink = sum;
+        }},
+        {"CPU::calc_ea", [&](UINT32 n){
+            UINT32 sum = 0;
+            for (UINT32 i = 0; i < n; i++){
+                sum += mb.calc_ea(i & 3, (SBYTE)i);
+            }
+            sink = sum;
+        }},
+        {"CPU::get_ea indexed", [&](UINT32 n){
+            UINT32 sum = 0;
+            for (UINT32 i = 0; i < n; i++){
+                sum += mb.get_ea(1 + (i & 1), (SBYTE)(i | 1));
+            }
+            sink = sum;
+        }},
+        {"CPU::get_ea auto-indexed +", [&](UINT32 n){
+            UINT32 sum = 0;
+            for (UINT32 i = 0; i < n; i++){
+                sum += mb.get_ea(BIT_OPCODE_MODE | 1, 1);
+            }
+            sink = sum;
+        }},
+        {"CPU::get_ea auto-indexed -", [&](UINT32 n){
+            UINT32 sum = 0;
+            for (UINT32 i = 0; i < n; i++){
+                sum += mb.get_ea(BIT_OPCODE_MODE | 2, -1);
+            }
+            sink = sum;
+        }},
+        {"CPU::get_ea disp=ER", [&](UINT32 n){
+            UINT32 sum = 0;
+            for (UINT32 i = 0; i < n; i++){
+                sum += mb.get_ea(3, -128);
+            }
+            sink = sum;
+        }},
+        {"CPU::get_data immediate", [&](UINT32 n){
+            UINT32 sum = 0;
+            for (UINT32 i = 0; i < n; i++){
+                sum += mb.get_data(BIT_OPCODE_MODE, (SBYTE)i);
+            }
+            sink = sum;
+        }},
+        {"CPU::get_data indexed", [&](UINT32 n){
+            UINT32 sum = 0;
+            for (UINT32 i = 0; i < n; i++){
+                sum += mb.get_data(1, (SBYTE)i);
+            }
+            sink = sum;
+        }},
+        {"CPU::get_data auto-indexed", [&](UINT32 n){
+            UINT32 sum = 0;
+            for (UINT32 i = 0; i < n; i++){
+                sum += mb.get_data(BIT_OPCODE_MODE | 1, 1);
+            }
+            sink = sum;
+        }},
+        {"CPU::add_byte", [&](UINT32 n){
+            BYTE a = 0;
+            for (UINT32 i = 0; i < n; i++){
+                a = mb.add_byte(a, (BYTE)i);
+            }
+            sink = a;
+        }},
+        {"CPU::add_bcd", [&](UINT32 n){
+            BYTE a = 0;
+            for (UINT32 i = 0; i < n; i++){
+                a = mb.add_bcd(a, 0x01);
+            }
+            sink = a;
+        }},
+        {"Memory::read", [&](UINT32 n){
+            UINT32 sum = 0;
+            for (UINT32 i = 0; i < n; i++){
+                sum += memory.read((WORD)(i * 17));
+            }
+            sink = sum;
+        }},
+        {"Memory::write", [&](UINT32 n){
+            for (UINT32 i = 0; i < n; i++){
+                memory.write((WORD)(0x4000 + (i & 0x3fff)), (BYTE)i);
+            }
+        }},
+        {"Disasm::unasm", [&](UINT32 n){
+            std::string assembler, ea;
+            UINT32 sum = 0;
+            disasm.save_pr();
+            for (UINT32 i = 0; i < n; i++){
+                disasm.unasm((WORD)(i * 13), assembler, ea);
+                sum += assembler.length();
+            }
+            sink = sum;
+        }},
+        {"Disasm::unasm(buffer)", [&](UINT32 n){
+            char assembler[DISASM_TEXT], ea[DISASM_TEXT];
+            UINT32 sum = 0;
+            disasm.save_pr();
+            for (UINT32 i = 0; i < n; i++){
+                sum += disasm.unasm((WORD)(i * 13), assembler, ea);
+            }
+            sink = sum;
+        }},
+        {"Util::hex2str(BYTE)", [&](UINT32 n){
+            UINT32 sum = 0;
+            for (UINT32 i = 0; i < n; i++){
+                sum += Util::hex2str((BYTE)i).length();
+            }
+            sink = sum;
+        }},
+        {"Util::hex2str(WORD)", [&](UINT32 n){
+            UINT32 sum = 0;
+            for (UINT32 i = 0; i < n; i++){
+                sum += Util::hex2str((WORD)i).length();
+            }
+            sink = sum;
+        }},
+        {"Memory::load 64KB", [&](UINT32 n){
+            std::streambuf *buf = std::cout.rdbuf(discard.rdbuf());
+            for (UINT32 i = 0; i < n; i++){
+                memory.load(srec);
+                discard.str("");
+            }
+            std::cout.rdbuf(buf);
+        }},
+    };
+
+    std::vector<Stat> stats;
+    for (auto &bench : benches){
+        if (bench.first.find(filter) == std::string::npos){
+            continue;
+        }
+        stats.push_back(measure(bench.first, samples, bench.second));
+    }
+    unlink(srec);
+
+    if (json){
+        std::cout << "{" << std::endl;
+        std::cout << "  \"samples\": " << samples << "," << std::endl;
+        std::cout << "  \"benchmarks\": [" << std::endl;
+        for (size_t i = 0; i < stats.size(); i++){
+            std::cout << std::fixed << std::setprecision(3);
+            std::cout << "    {\"name\": \"" << stats[i].name << "\"";
+            std::cout << ", \"min\": " << stats[i].min;
+            std::cout << ", \"median\": " << stats[i].median;
+            std::cout << ", \"mean\": " << stats[i].mean;
+            std::cout << ", \"stddev\": " << stats[i].stddev << "}";
+            std::cout << (i + 1 < stats.size() ? "," : "") << std::endl;
+        }
+        std::cout << "  ]" << std::endl;
+        std::cout << "}" << std::endl;
+    }
+    else {
+        std::cout << std::left << std::setw(28) << "benchmark (ns/op)";
+        std::cout << std::right << std::setw(12) << "min" << std::setw(12) << "median";
+        std::cout << std::setw(12) << "mean" << std::setw(12) << "stddev" << std::endl;
+        for (auto &stat : stats){
+            std::cout << std::left << std::setw(28) << stat.name << std::right << std::fixed << std::setprecision(2);
+            std::cout << std::setw(12) << stat.min << std::setw(12) << stat.median;
+            std::cout << std::setw(12) << stat.mean << std::setw(12) << stat.stddev << std::endl;
+        }
+    }
+
+    return (0);
+}
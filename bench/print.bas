@@ -0,0 +1,5 @@
+10 FOR I=1 TO 300
+20 PRINT "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG ",I
+30 NEXT I
+40 END
+RUN
@@ -0,0 +1,16 @@
+10 T=TOP
+20 N=2000
+30 FOR I=0 TO N
+40 @(T+I)=1
+50 NEXT I
+60 C=0
+70 FOR I=2 TO N
+80 IF @(T+I)=0 THEN GOTO 130
+90 C=C+1
+100 FOR J=I+I TO N STEP I
+110 @(T+J)=0
+120 NEXT J
+130 NEXT I
+140 PRINT C
+150 END
+RUN
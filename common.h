@@ -1,17 +1,18 @@
-#ifndef COMMON_H
-#define COMMON_H
-
-typedef unsigned char UINT8;
-typedef signed char INT8;
-typedef signed short INT16;
-typedef unsigned short UINT16;
-typedef unsigned int UINT32;
-
-typedef UINT8 BYTE;
-typedef INT8 SBYTE;
-typedef UINT16 WORD;
-
-// mask for byte data
-const BYTE BIT_SIGN_BYTE = 0x80;
-
+#ifndef COMMON_H
+#define COMMON_H
+
+typedef unsigned char UINT8;
+typedef signed char INT8;
+typedef signed short INT16;
+typedef unsigned short UINT16;
+typedef unsigned int UINT32;
+typedef unsigned long long UINT64;
+
+typedef UINT8 BYTE;
+typedef INT8 SBYTE;
+typedef UINT16 WORD;
+
+// mask for byte data
+const BYTE BIT_SIGN_BYTE = 0x80;
+
 #endif
\ No newline at end of file
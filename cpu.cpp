@@ -1,146 +1,294 @@
-#include "common.h" 
-#include "memory.hpp"
-#include "cpu.hpp" 
-
-
-CPU::CPU(Memory &mem): memory(mem)
-{
-    CPU::reset();
-    CPU::run_mode(RUN);
-}
-
-void CPU::run_mode(CPUMODE mode)
-{
-    runmode = mode;
-}
-
-void CPU::reset()
-{
-    // clear all registers
-    reg.AC = 0;
-    reg.ER = 0;
-    reg.SR = 0;
-    reg.PR[0] = 0;
-    reg.PR[1] = 0;
-    reg.PR[2] = 0;
-    reg.PR[3] = 0;
-}
-
-CPUSTAT CPU::clock()
-{
-    CPUSTAT stat;
-
-    stat = CPU::interrupt();                   // if IE & SA then interrupt
-    if (stat == SUCCESS){
-        BYTE opcode = CPU::fetch();
-        if ((opcode & BIT_SIGN_BYTE) == 0){
-            stat = CPU::exec(opcode);
-        }
-        else {
-            SBYTE disp = CPU::fetch();      // fetch 2nd byte of instruction
-            stat = CPU::exec(opcode, disp);
-        }
-    }
-    return (stat);
-}
-
-CPUSTAT CPU::interrupt()
-{
-    if ((reg.SR & BIT_SR_IE) != 0 && ((reg.SR & BIT_SR_SA) != 0)){
-        reg.SR &= ~BIT_SR_IE;       // clear IE
-        CPU::execXPPC(3);           // XPPC P3
-
-        return (INTERRPT);   
-    }
-    return (SUCCESS);
-}
-BYTE CPU::fetch()
-{
-    WORD ea = calc_ea(0, 1);            // increment PC
-    reg.PR[0] = ea;
-    BYTE data = memory.read(ea);        // memory fetch
-
-    return (data);
-}
-
-WORD CPU::calc_ea(int pr, SBYTE disp)
-{
-    WORD ea = (reg.PR[pr] & BIT_PR_PAGE) | ((reg.PR[pr] + disp) & ~BIT_PR_PAGE);
-
-    return (ea);
-}
-
-WORD CPU::get_ea(int addressing, SBYTE disp)
-{
-    WORD ea;
-
-    if (disp == -128){
-        disp = reg.ER;
-    }
-
-    int pr = addressing & BIT_OPCODE_PR;
-
-    if ((addressing & BIT_OPCODE_MODE) == 0){      // Indexed Addressing
-        ea = calc_ea(pr, disp);
-    }
-    else {                                  // Auto-Indexed Addressing
-        if (disp < 0){
-            ea = calc_ea(pr, disp);
-            reg.PR[pr] = ea; 
-        }
-        else {
-            ea = reg.PR[pr];
-            reg.PR[pr] = calc_ea(pr, disp);
-        }
-    }
-
-    return (ea);
-}
-
-SBYTE CPU::get_data(int addressing, SBYTE disp)
-{
-    BYTE data;
-    if ((addressing & (BIT_OPCODE_MODE | BIT_OPCODE_PR)) == 4){   // Immediate Addressing
-        data = (BYTE)disp;
-    }
-    else {                              // Indexed or Auto-Indexed Addressing
-        WORD ea = get_ea(addressing, disp);
-        data = memory.read(ea);
-    }
-
-    return (data);
-}
-
-BYTE CPU::add_byte(BYTE a, BYTE b)
-{
-    WORD c = (WORD)a + (WORD)b + ((reg.SR & BIT_SR_CY) == 0 ? 0: 1);
-
-    // Carry
-    reg.SR = (reg.SR & ~BIT_SR_CY) | ((c & 0x0100) >> 1);
-
-    // オーバーフローの条件　正+正=負、負+負=正
-    reg.SR &= ~BIT_SR_OV;
-    if (((a & BIT_SIGN_BYTE) == (b & BIT_SIGN_BYTE)) && ((a & BIT_SIGN_BYTE) != (c & BIT_SIGN_BYTE))){
-        reg.SR = reg.SR | BIT_SR_OV;
-    }
-
-    return ((BYTE)c);
-}
-
-BYTE CPU::add_bcd(BYTE a, BYTE b)
-{
-    WORD c = (WORD)a + (WORD)b + ((reg.SR & BIT_SR_CY) == 0 ? 0: 1);
-
-    if (c % 16 >= 0x0a){
-        c += 6;
-    }
-
-    if (c >= 0xa0){
-        c += 0x60;
-    }
-
-    // Carry
-    reg.SR = (reg.SR & ~BIT_SR_CY) | ((c & 0x0100) >> 1);
-
-    return ((BYTE)c);
-}
+#include "common.h" 
+#include "memory.hpp"
+#include "io.hpp"
+#include "cpu.hpp" 
+#include "hle.hpp"
+#include "memo.hpp"
+#include "aot.hpp"
+#include "opstats.hpp"
+
+static IOChannel null_channel;      // no input, output is discarded
+
+// micro cycles of each opcode (conditional jump: not taken, DLY: minimum)
+const BYTE CPU::cycle_table[256] = {
+     8,  7,  5,  5,  6,  6,  5,  6,  5,  0,  0,  0,  0,  0,  0,  0,   // 00
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  5,  0,  0,  5,  5,  5,  5,   // 10
+     5,  5,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,   // 20
+     8,  8,  8,  8,  8,  8,  8,  8,  0,  0,  0,  0,  7,  7,  7,  7,   // 30
+     6,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,   // 40
+     6,  0,  0,  0,  0,  0,  0,  0,  6,  0,  0,  0,  0,  0,  0,  0,   // 50
+     6,  0,  0,  0,  0,  0,  0,  0, 11,  0,  0,  0,  0,  0,  0,  0,   // 60
+     7,  0,  0,  0,  0,  0,  0,  0,  8,  0,  0,  0,  0,  0,  0,  0,   // 70
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 13,   // 80
+    11, 11, 11, 11,  9,  9,  9,  9,  9,  9,  9,  9,  9,  9,  9,  9,   // 90
+     0,  0,  0,  0,  0,  0,  0,  0, 22, 22, 22, 22,  0,  0,  0,  0,   // A0
+     0,  0,  0,  0,  0,  0,  0,  0, 22, 22, 22, 22,  0,  0,  0,  0,   // B0
+    18, 18, 18, 18, 10, 18, 18, 18, 18, 18, 18, 18,  0, 18, 18, 18,   // C0
+    18, 18, 18, 18, 10, 18, 18, 18, 18, 18, 18, 18, 10, 18, 18, 18,   // D0
+    18, 18, 18, 18, 10, 18, 18, 18, 23, 23, 23, 23, 15, 23, 23, 23,   // E0
+    19, 19, 19, 19, 11, 19, 19, 19, 20, 20, 20, 20, 12, 20, 20, 20    // F0
+};
+
+CPU::CPU(Memory &mem): memory(mem)
+{
+    CPU::set_io(&null_channel, &null_channel);
+    CPU::clear_counters();
+
+    fast_forward = true;
+    fusion = true;
+    yield_output = false;
+    entries = nullptr;
+    pass = 0;
+    loop_hint = false;
+    hle = nullptr;
+    memo = nullptr;
+    aot = nullptr;
+    opstats = nullptr;
+    call_hint = false;
+    for (auto &jump : loop_reject){
+        jump = 0;
+    }
+    CPU::reset();
+    CPU::run_mode(RUN);
+}
+
+void CPU::run_mode(CPUMODE mode)
+{
+    runmode = mode;
+}
+
+void CPU::set_io(IOChannel *in, IOChannel *out)
+{
+    io_in = in;
+    io_out = out;
+}
+
+void CPU::reset()
+{
+    // clear all registers
+    reg.AC = 0;
+    reg.ER = 0;
+    reg.SR = 0;
+    flags_lazy = false;
+    reg.PR[0] = 0;
+    reg.PR[1] = 0;
+    reg.PR[2] = 0;
+    reg.PR[3] = 0;
+}
+
+CPUSTAT CPU::clock()
+{
+    CPUSTAT stat;
+
+    stat = CPU::interrupt();                   // if IE & SA then interrupt
+    if (stat == SUCCESS){
+        BYTE opcode = CPU::fetch();
+        SBYTE disp = 0;
+        if ((opcode & BIT_SIGN_BYTE) == 0){
+            stat = CPU::exec(opcode);
+        }
+        else {
+            disp = CPU::fetch();            // fetch 2nd byte of instruction
+            stat = CPU::exec(opcode, disp);
+        }
+        if (stat != WAIT_INPUT){            // GETC is executed again
+            insts++;
+            cycles += cycle_table[opcode];
+            if (opstats != nullptr){
+                opstats->record(opcode, disp);
+            }
+        }
+    }
+    else {
+        cycles += cycle_table[OPE_XPPC];
+    }
+    return (stat);
+}
+
+CPUSTAT CPU::run(UINT64 insts_limit, UINT64 cycles_limit)
+{
+    CPUSTAT stat = SUCCESS;
+    bool shortcut = (opstats == nullptr);     // every instruction by clock() while counting
+
+    loop_hint = false;
+    call_hint = false;
+    while (insts < insts_limit && cycles < cycles_limit){
+        BYTE entry = (entries == nullptr) ? 0 : entries[CPU::calc_ea(0, 1)];
+
+        if (entry != 0){
+            if ((entry & ENTRY_BREAK) != 0){
+                if (CPU::calc_ea(0, 1) + 1U != pass){
+                    stat = BREAK;
+                    break;
+                }
+                pass = 0;
+            }
+            if (shortcut && (entry & ENTRY_HLE) != 0 &&
+                hle->trap(*this, memory, insts_limit - insts, cycles_limit - cycles, stat)){
+                loop_hint = false;
+                call_hint = false;
+                if (stat != SUCCESS && stat != INTERRPT){
+                    break;
+                }
+                continue;
+            }
+            if (shortcut && (entry & ENTRY_AOT) != 0 && CPU::run_block(insts_limit, cycles_limit)){
+                loop_hint = false;
+                call_hint = false;
+                stat = SUCCESS;
+                continue;
+            }
+        }
+        if (shortcut && fusion && (entry & ENTRY_STEP) == 0 &&
+            CPU::fusible(memory.peek((reg.PR[0] & BIT_PR_PAGE) | ((reg.PR[0] + 1) & ~BIT_PR_PAGE))) &&
+            CPU::exec_fused(insts_limit, cycles_limit)){
+            stat = SUCCESS;
+        }
+        else {
+            stat = CPU::clock();
+            if (stat != SUCCESS && stat != INTERRPT){
+                break;
+            }
+        }
+        if (call_hint){
+            call_hint = false;
+            if (shortcut && memo != nullptr){
+                memo->xppc(*this, call_site, stat == INTERRPT, insts_limit - insts, cycles_limit - cycles);
+            }
+        }
+        if (loop_hint){
+            loop_hint = false;
+            if (shortcut && fast_forward){
+                CPU::skip_loop(insts_limit, cycles_limit);
+            }
+        }
+    }
+    pass = 0;
+    if (memo != nullptr){
+        memo->abort();          // a call is not recorded across run()
+    }
+    return ((stat == SUCCESS || stat == INTERRPT) ? SUCCESS : stat);
+}
+
+// compiled block at PC + 1, if it fits in the limits (false: interpret)
+bool CPU::run_block(UINT64 insts_limit, UINT64 cycles_limit)
+{
+    const AOTBlock *block = aot->find(CPU::calc_ea(0, 1));
+
+    if (block == nullptr || ((reg.SR & BIT_SR_IE) != 0 && (reg.SR & BIT_SR_SA) != 0)){
+        return (false);
+    }
+    if (insts + block->insts > insts_limit || cycles + block->max_cycles > cycles_limit){
+        return (false);
+    }
+    CPU::flags();               // blocks use reg.SR
+    UINT32 executed = block->func(reg, memory, cycles);
+    if (executed == 0){
+        return (false);         // code modified
+    }
+    insts += executed;
+    aot_hits++;
+
+    return (true);
+}
+
+CPUSTAT CPU::interrupt()
+{
+    if ((reg.SR & BIT_SR_IE) != 0 && ((reg.SR & BIT_SR_SA) != 0)){
+        reg.SR &= ~BIT_SR_IE;       // clear IE
+        CPU::execXPPC(3);           // XPPC P3
+        interrupts++;
+
+        return (INTERRPT);   
+    }
+    return (SUCCESS);
+}
+BYTE CPU::fetch()
+{
+    WORD ea = calc_ea(0, 1);            // increment PC
+    reg.PR[0] = ea;
+    BYTE data = memory.fetch(ea);       // memory fetch
+
+    return (data);
+}
+
+WORD CPU::calc_ea(int pr, SBYTE disp)
+{
+    WORD ea = (reg.PR[pr] & BIT_PR_PAGE) | ((reg.PR[pr] + disp) & ~BIT_PR_PAGE);
+
+    return (ea);
+}
+
+WORD CPU::get_ea(int addressing, SBYTE disp)
+{
+    WORD ea;
+
+    if (disp == -128){
+        disp = reg.ER;
+    }
+
+    int pr = addressing & BIT_OPCODE_PR;
+
+    if ((addressing & BIT_OPCODE_MODE) == 0){      // Indexed Addressing
+        ea = calc_ea(pr, disp);
+    }
+    else {                                  // Auto-Indexed Addressing
+        if (disp < 0){
+            ea = calc_ea(pr, disp);
+            reg.PR[pr] = ea; 
+        }
+        else {
+            ea = reg.PR[pr];
+            reg.PR[pr] = calc_ea(pr, disp);
+        }
+    }
+
+    return (ea);
+}
+
+SBYTE CPU::get_data(int addressing, SBYTE disp)
+{
+    BYTE data;
+    if ((addressing & (BIT_OPCODE_MODE | BIT_OPCODE_PR)) == 4){   // Immediate Addressing
+        data = (BYTE)disp;
+    }
+    else {                              // Indexed or Auto-Indexed Addressing
+        WORD ea = get_ea(addressing, disp);
+        data = memory.read(ea);
+    }
+
+    return (data);
+}
+
+BYTE CPU::add_byte(BYTE a, BYTE b)
+{
+    WORD c = (WORD)a + (WORD)b + CPU::carry();
+
+    // Carry, Overflow: by flags() when read
+    // オーバーフローの条件　正+正=負、負+負=正
+    lazy_a = a;
+    lazy_b = b;
+    lazy_c = c;
+    flags_lazy = true;
+
+    return ((BYTE)c);
+}
+
+BYTE CPU::add_bcd(BYTE a, BYTE b)
+{
+    CPU::flags();               // OV is kept
+    WORD c = (WORD)a + (WORD)b + ((reg.SR & BIT_SR_CY) == 0 ? 0: 1);
+
+    if (c % 16 >= 0x0a){
+        c += 6;
+    }
+
+    if (c >= 0xa0){
+        c += 0x60;
+    }
+
+    // Carry
+    reg.SR = (reg.SR & ~BIT_SR_CY) | ((c & 0x0100) >> 1);
+
+    return ((BYTE)c);
+}
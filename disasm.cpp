@@ -1,414 +1,286 @@
-#include <iostream>
-#include <iomanip>      // for std::setw, std::setfill>
-#include <sstream>
-#include <string>
-#include "common.h" 
-#include "util.hpp"
-#include "memory.hpp"
-#include "cpu.hpp"
-#include "monitor.hpp"
-#include "disasm.hpp"
-
-
-Disasm::Disasm(Memory &mem, CPU &cpu): memory(mem), cpu(cpu)
-{
-}
-
-void Disasm::unasm(WORD addr, std::string &assembler, std::string &ea)
-{
-    BYTE opcode = memory.read(addr);
-
-    if ((opcode & BIT_SIGN_BYTE) == 0){
-        disasm(opcode, assembler);
-        ea = "";
-    }
-    else {
-        SBYTE operand = memory.read(addr + 1);
-        disasm(addr, opcode, operand, assembler, ea);
-    }
-}
-
-std::string Disasm::mem(WORD addr)
-{
-    std::stringstream out;
-    BYTE data;
-
-    out << std::hex;
-    out << Util::hex2str(addr);
-    out << ":";
-
-    data = memory.read((WORD)addr);
-    out << Util::hex2str(data);
-    if ((data & BIT_SIGN_BYTE) != 0){
-        out << " ";
-        data = memory.read(addr + 1);
-        out << Util::hex2str(data);
-    }
-
-    return (out.str());
-}
-
-void Disasm::disasm(BYTE opcode, std::string &assembler)
-{
-    std::string out;
-    int inst;
-
-    inst = opcode;
-    if (OPE_XPAL <= opcode && opcode <= OPE_XPPC + 3){
-        inst &= ~BIT_OPCODE_PR;
-    }
-
-    switch (inst){
-    case OPE_HALT:  // Halt
-        assembler = "HALT";
-        break;
-
-    case OPE_XAE:   // Exchange AC and Extention   AC <-> E
-        assembler = "XAE";
-        break;
-
-    case OPE_CCL:   // Clear Carry/Link
-        assembler = "CCL";
-        break;
-
-    case OPE_SCL:   // Set Carry/Link
-        assembler = "SCL";
-        break;
-
-    case OPE_DINT:  // Disable Interrupt
-        assembler = "DINT";
-        break;
-
-    case OPE_IEN:   // Enable Interrupt
-        assembler = "IEN";
-        break;
-
-    case OPE_CSA:   // Copy Status to AC
-        assembler = "CSA";
-        break;
-
-    case OPE_CAS:   // Copy AC to Status
-        assembler = "CAS";
-        break;
-
-    case OPE_NOP:   // No Operation
-        assembler = "NOP";
-        break;
-
-    case OPE_SIO:   // Serial Input/Output
-        assembler = "SIO";
-        break;
-
-    case OPE_SR:    // Shift Right
-        assembler = "SR";
-        break;
-
-    case OPE_SRL:   // Shift Right with Link
-        assembler = "SRL";
-        break;
-
-    case OPE_RR:    // Rotate Right
-        assembler = "RR";
-        break;
-
-    case OPE_RRL:   // Rotate Right with Link
-        assembler = "RRL";
-        break;
-
-    case OPE_XPAL:  // Exchange Pointer Low
-        assembler = "XPAL " + operandPR(opcode);
-        break;
-
-    case OPE_XPAH:  // Exchange Pointer High
-        assembler = "XPAH " + operandPR(opcode);
-        break;
-
-    case OPE_XPPC:  // Exchange Pointer with PC
-        assembler = "XPPC " + operandPR(opcode);
-        break;
-
-    case OPE_LDE:   // Load AC from Extention
-        assembler = "LDE";
-        break;
-
-    case OPE_ANE:   // AND Extention
-        assembler = "ANE";
-        break;
-
-    case OPE_ORE:   // OR Extention
-        assembler = "ORE";
-        break;
-
-    case OPE_XRE:   // Exclusive OR Extention
-        assembler = "XRE";
-        break;
-
-    case OPE_DAE:   // Decimal Add Extention
-        assembler = "DAE";
-        break;
-
-    case OPE_ADE:   // Add Extention
-        assembler = "ADE";
-        break;
-
-    case OPE_CAE:   // Compulement and Add Extention
-        assembler = "CAE";
-        break;
-
-    case OPE_PUTC:  // putc() for NIBL
-        assembler = "PUTC";
-        break;
-
-    case OPE_GETC:  // getc() for NIBL
-        assembler = "GETC";
-        break;
-
-    default:
-        assembler = "UND";
-    }
-}
-
-std::string Disasm::operandPR(BYTE opcode)
-{
-    std::string out[] = {"PC", "P1", "P2", "P3"};
-
-    return (out[opcode & BIT_OPCODE_PR]);
-}
-
-void Disasm::disasm(WORD addr, BYTE opcode, SBYTE operand, std::string &assembler, std::string &ea)
-{
-    int inst = opcode;
-
-    if (0x90 <= opcode && opcode <= 0x9f){  // JMP, JP, JZ, JNZ
-        inst &= 0xfc;
-    }
-    else if (0xA8 <= opcode && opcode <= 0xAB){  // ILD
-        inst &= 0xfc;
-    }
-    else if (0xB8 <= opcode && opcode <= 0xBB){  // ILD
-        inst &= 0xfc;
-    }
-    else if (opcode >= 0xc0){ // LD, ST, AND, OR, XOR, DAD, ADD, CAD
-        inst &= 0xf8;
-    }
-
-    ea = "";
-    switch (inst){
-    case OPE_DLY:
-        assembler = "DLY  " + operand_str(operand, 10);
-        break;
-
-    case OPE_JMP:
-        assembler = "JMP  " + operand_addressing(opcode & BIT_OPCODE_PR, operand);
-        ea = ea_jump(addr, opcode & BIT_OPCODE_PR, operand);
-        break;
-
-    case OPE_JP:
-        assembler = "JP   " + operand_addressing(opcode & BIT_OPCODE_PR, operand);
-        ea = ea_jump(addr, opcode & BIT_OPCODE_PR, operand);
-        break;
-
-    case OPE_JZ:
-        assembler = "JZ   " + operand_addressing(opcode & BIT_OPCODE_PR, operand);
-        ea = ea_jump(addr, opcode & BIT_OPCODE_PR, operand);
-        break;
-
-    case OPE_JNZ:
-        assembler = "JNZ  " + operand_addressing(opcode & BIT_OPCODE_PR, operand);
-        ea = ea_jump(addr, opcode & BIT_OPCODE_PR, operand);
-        break;
-
-    case OPE_ILD:
-        assembler = "ILD  " + operand_addressing(opcode & BIT_OPCODE_PR, operand);
-        ea = ea_memory(addr, opcode & BIT_OPCODE_PR, operand);
-        break;
-
-    case OPE_DLD:
-        assembler = "DLD  " + operand_addressing(opcode & BIT_OPCODE_PR, operand);
-        ea = ea_memory(addr, opcode & BIT_OPCODE_PR, operand);
-        break;
-
-    case OPE_LD:    // LD, LDI
-        if (opcode == OPE_LDI){
-            assembler = "LDI  ";
-            assembler += operand_addressing(opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-        }
-        else {
-            assembler = "LD   ";
-            assembler += operand_addressing(opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-            ea = ea_memory(addr, opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-        }
-        break;
-
-    case OPE_ST:
-        if ((opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR)) == 4){
-            assembler = "UND";
-        }
-        else {
-            assembler = "ST   ";
-            assembler += operand_addressing(opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-            ea = ea_memory(addr, opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-        }
-        break;
-
-    case OPE_AND:   // AND, ANI
-        if (opcode == OPE_ANI){
-            assembler = "ANI  ";
-            assembler += operand_addressing(opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-        }
-        else {
-            assembler = "AND  ";
-            assembler += operand_addressing(opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-            ea = ea_memory(addr, opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-        }
-        break;
-
-    case OPE_OR:    // OR, ORI
-        if (opcode == OPE_ORI){
-            assembler = "ORI  ";
-            assembler += operand_addressing(opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-        }
-        else {
-            assembler = "OR   ";
-            assembler += operand_addressing(opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-            ea = ea_memory(addr, opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-        }
-        break;
-
-    case OPE_XOR:   // XOR, XRI
-        if (opcode == OPE_XRI){
-            assembler = "XRI  ";
-            assembler += operand_addressing(opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-        }
-        else {
-            assembler = "XOR  ";
-            assembler += operand_addressing(opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-            ea = ea_memory(addr, opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-        }
-        break;
-
-    case OPE_DAD:   // DAD, DAI
-        if (opcode == OPE_DAI){
-            assembler = "DAI  ";
-            assembler += operand_addressing(opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-        }
-        else {
-            assembler = "DAD  ";
-            assembler += operand_addressing(opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-            ea = ea_memory(addr, opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-        }
-        break;
-
-    case OPE_ADD:   // ADD, ADI
-        if (opcode == OPE_ADI){
-            assembler = "ADI  ";
-            assembler += operand_addressing(opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-        }
-        else {
-            assembler = "ADD  ";
-            assembler += operand_addressing(opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-            ea = ea_memory(addr, opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-        }
-        break;
-
-    case OPE_CAD:   // CAD, CAI
-        if (opcode == OPE_CAI){
-            assembler = "CAI  ";
-            assembler += operand_addressing(opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-        }
-        else {
-            assembler = "CAD  ";
-            assembler += operand_addressing(opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-            ea = ea_memory(addr, opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR), operand);
-        }
-        break;
-
-    default:        // undefined instruction
-        assembler = "UND";
-    }
-}
-
-std::string Disasm::operand_str(SBYTE operand, int base)
-{
-    std::stringstream out;
-
-    if (base == 10){
-        out << std::dec << (int)operand;
-    }
-    else {
-        out << "0x" << Util::hex2str((BYTE)operand);
-    }
-
-    return (out.str());
-}
-
-std::string Disasm::operand_addressing(int addressing, SBYTE operand)
-{
-    std::string mode[] = {"", "(P1)", "(P2)", "(P3)"};
-    std::string out;
-
-    if ((addressing & (BIT_OPCODE_MODE | BIT_OPCODE_PR)) == 4){
-        out = operand_str(operand, 16);
-    }
-    else {
-        if ((addressing & BIT_OPCODE_MODE) != 0){
-            out = "@";
-        }
-        out += operand_str(operand, 10) + mode[addressing & BIT_OPCODE_PR];
-
-    }
-    return (out);
-}
-
-std::string Disasm::ea_jump(WORD addr, int addressing, SBYTE disp)
-{
-    std::stringstream out;
-
-    WORD ea = disasm_ea(addr, addressing, disp);
-
-    out << "JUMP=" << Util::hex2str(ea);
-
-    return (out.str());
-}
-
-std::string Disasm::ea_memory(WORD addr, int addressing, SBYTE operand)
-{
-    std::stringstream out;    
-    WORD ea = disasm_ea(addr, addressing, operand); 
-
-    out << "EA=" << Util::hex2str(ea);
-    out << "(" << Util::hex2str(memory.read(ea)) << ")"; 
-
-    return (out.str());
-}
-
-void Disasm::save_pr()
-{
-    pr[0] = cpu.getPC() + 1;
-    pr[1] = cpu.getP1();
-    pr[2] = cpu.getP2();
-    pr[3] = cpu.getP3();
-}
-
-WORD Disasm::disasm_ea(WORD addr, int addressing, SBYTE disp)
-{
-    WORD ptr, ea;
-
-    ptr = pr[addressing & BIT_OPCODE_PR];
-
-    if (disp == -128){
-        disp = cpu.getER();
-    }
-    if ((addressing & BIT_OPCODE_MODE) == 0){      // Indexed Addressing
-        ea = (ptr & BIT_PR_PAGE) | ((ptr + disp) & ~BIT_PR_PAGE);
-    }
-    else {                                  // Auto-Indexed Addressing
-        if (disp < 0){
-            ea = (ptr & BIT_PR_PAGE) | ((ptr + disp + 1) & ~BIT_PR_PAGE);
-        }
-        else {
-            ea = ptr;       
-        }
-    }
-    return (ea);
-}
\ No newline at end of file
+#include <iostream>
+#include <string>
+#include <array>
+#include "common.h"
+#include "memory.hpp"
+#include "cpu.hpp"
+#include "disasm.hpp"
+
+//
+// opcode table (built at compile time)
+//
+static constexpr std::array<DisasmInfo, 256> make_table()
+{
+    std::array<DisasmInfo, 256> table = {};
+
+    for (int op = 0; op < 256; op++){
+        table[op] = {"UND", (BYTE)((op & BIT_SIGN_BYTE) == 0 ? 1 : 2), DIS_UND, 0, false};
+    }
+
+    // single-byte instruction
+    const struct {BYTE opcode; const char *mnemonic;} single[] = {
+        {OPE_HALT, "HALT"}, {OPE_XAE, "XAE"}, {OPE_CCL, "CCL"}, {OPE_SCL, "SCL"},
+        {OPE_DINT, "DINT"}, {OPE_IEN, "IEN"}, {OPE_CSA, "CSA"}, {OPE_CAS, "CAS"},
+        {OPE_NOP, "NOP"}, {OPE_SIO, "SIO"}, {OPE_SR, "SR"}, {OPE_SRL, "SRL"},
+        {OPE_RR, "RR"}, {OPE_RRL, "RRL"}, {OPE_LDE, "LDE"}, {OPE_ANE, "ANE"},
+        {OPE_ORE, "ORE"}, {OPE_XRE, "XRE"}, {OPE_DAE, "DAE"}, {OPE_ADE, "ADE"},
+        {OPE_CAE, "CAE"}, {OPE_PUTC, "PUTC"}, {OPE_GETC, "GETC"}
+    };
+    for (auto &s : single){
+        table[s.opcode] = {s.mnemonic, 1, DIS_NONE, 0, false};
+    }
+    for (int pr = 0; pr < 4; pr++){
+        table[OPE_XPAL + pr] = {"XPAL", 1, DIS_PTR, (BYTE)pr, false};
+        table[OPE_XPAH + pr] = {"XPAH", 1, DIS_PTR, (BYTE)pr, false};
+        table[OPE_XPPC + pr] = {"XPPC", 1, DIS_PTR, (BYTE)pr, false};
+    }
+
+    // double-byte instruction
+    table[OPE_DLY] = {"DLY", 2, DIS_COUNT, 0, false};
+    for (int pr = 0; pr < 4; pr++){
+        table[OPE_JMP + pr] = {"JMP", 2, DIS_JUMP, (BYTE)pr, false};
+        table[OPE_JP + pr] = {"JP", 2, DIS_JUMP, (BYTE)pr, false};
+        table[OPE_JZ + pr] = {"JZ", 2, DIS_JUMP, (BYTE)pr, false};
+        table[OPE_JNZ + pr] = {"JNZ", 2, DIS_JUMP, (BYTE)pr, false};
+        table[OPE_ILD + pr] = {"ILD", 2, DIS_MEMORY, (BYTE)pr, false};
+        table[OPE_DLD + pr] = {"DLD", 2, DIS_MEMORY, (BYTE)pr, false};
+    }
+    const struct {BYTE opcode; const char *mnemonic; const char *immediate;} memory_ops[] = {
+        {OPE_LD, "LD", "LDI"}, {OPE_ST, "ST", nullptr}, {OPE_AND, "AND", "ANI"}, {OPE_OR, "OR", "ORI"},
+        {OPE_XOR, "XOR", "XRI"}, {OPE_DAD, "DAD", "DAI"}, {OPE_ADD, "ADD", "ADI"}, {OPE_CAD, "CAD", "CAI"}
+    };
+    for (auto &m : memory_ops){
+        for (int mode = 0; mode < 8; mode++){
+            if (mode == BIT_OPCODE_MODE){           // immediate (ST: undefined)
+                if (m.immediate != nullptr){
+                    table[m.opcode + mode] = {m.immediate, 2, DIS_IMMEDIATE, 0, false};
+                }
+            }
+            else {
+                table[m.opcode + mode] = {m.mnemonic, 2, DIS_MEMORY, (BYTE)(mode & BIT_OPCODE_PR), (mode & BIT_OPCODE_MODE) != 0};
+            }
+        }
+    }
+
+    return (table);
+}
+
+static constexpr std::array<DisasmInfo, 256> table = make_table();
+
+static const char *const pr_name[] = {"PC", "P1", "P2", "P3"};
+static const char *const pr_suffix[] = {"", "(P1)", "(P2)", "(P3)"};
+
+// writers into a buffer, each returns the end
+static char *put_str(char *p, const char *s)
+{
+    while (*s != '\0'){
+        *p++ = *s++;
+    }
+    return (p);
+}
+
+static char *put_hex(char *p, UINT32 n, int digits)
+{
+    static const char digit[] = "0123456789abcdef";
+
+    for (int i = digits - 1; i >= 0; i--){
+        *p++ = digit[(n >> (i * 4)) & 0x0f];
+    }
+    return (p);
+}
+
+static char *put_dec(char *p, int n)
+{
+    if (n < 0){
+        *p++ = '-';
+        n = -n;
+    }
+    if (n >= 100){
+        *p++ = '0' + n / 100;
+    }
+    if (n >= 10){
+        *p++ = '0' + n / 10 % 10;
+    }
+    *p++ = '0' + n % 10;
+
+    return (p);
+}
+
+Disasm::Disasm(Memory &mem, CPU &cpu): memory(mem), cpu(cpu)
+{
+}
+
+const DisasmInfo &Disasm::info(BYTE opcode)
+{
+    return (table[opcode]);
+}
+
+int Disasm::unasm(WORD addr, char *assembler, char *ea)
+{
+    BYTE opcode = memory.peek(addr);
+    const DisasmInfo &op = table[opcode];
+    char *p = put_str(assembler, op.mnemonic);
+    char *q = ea;
+
+    if (op.cls == DIS_PTR){
+        *p++ = ' ';
+        p = put_str(p, pr_name[op.pr]);
+    }
+    else if (op.cls != DIS_UND && op.length == 2){
+        SBYTE disp = memory.peek(addr + 1);
+        int addressing = op.pr | (op.autoindex ? BIT_OPCODE_MODE : 0);
+
+        while (p < assembler + 5){
+            *p++ = ' ';
+        }
+        switch (op.cls){
+        case DIS_COUNT:
+            p = put_dec(p, disp);
+            break;
+
+        case DIS_IMMEDIATE:
+            p = put_str(p, "0x");
+            p = put_hex(p, (BYTE)disp, 2);
+            break;
+
+        case DIS_JUMP:
+            p = put_dec(p, disp);
+            p = put_str(p, pr_suffix[op.pr]);
+            q = put_str(q, "JUMP=");
+            q = put_hex(q, Disasm::disasm_ea(addr, addressing, disp), 4);
+            break;
+
+        case DIS_MEMORY: {
+            WORD target = Disasm::disasm_ea(addr, addressing, disp);
+
+            if (op.autoindex){
+                *p++ = '@';
+            }
+            p = put_dec(p, disp);
+            p = put_str(p, pr_suffix[op.pr]);
+            q = put_str(q, "EA=");
+            q = put_hex(q, target, 4);
+            *q++ = '(';
+            q = put_hex(q, memory.peek(target), 2);
+            *q++ = ')';
+            break;
+        }
+        }
+    }
+    *p = '\0';
+    *q = '\0';
+
+    return (op.length);
+}
+
+int Disasm::mem(WORD addr, char *buf)
+{
+    BYTE opcode = memory.peek(addr);
+    char *p = buf;
+
+    p = put_hex(p, addr, 4);
+    *p++ = ':';
+    p = put_hex(p, opcode, 2);
+    if (table[opcode].length == 2){
+        *p++ = ' ';
+        p = put_hex(p, memory.peek(addr + 1), 2);
+    }
+    *p = '\0';
+
+    return (table[opcode].length);
+}
+
+void Disasm::unasm(WORD addr, std::string &assembler, std::string &ea)
+{
+    char text[DISASM_TEXT], ea_text[DISASM_TEXT];
+
+    Disasm::unasm(addr, text, ea_text);
+    assembler = text;
+    ea = ea_text;
+}
+
+std::string Disasm::mem(WORD addr)
+{
+    char text[DISASM_TEXT];
+
+    Disasm::mem(addr, text);
+
+    return (text);
+}
+
+// mnemonic of opcode without displacement (XPAL etc. with pointer)
+std::string Disasm::mnemonic(BYTE opcode)
+{
+    const DisasmInfo &op = table[opcode];
+
+    if (op.cls == DIS_PTR){
+        return (std::string(op.mnemonic) + " " + pr_name[op.pr]);
+    }
+    return (op.mnemonic);
+}
+
+// lines of 13 columns of bytes and the assembler, written by blocks
+UINT32 Disasm::list(std::ostream &out, WORD start, WORD end)
+{
+    const int BLOCK = 64 * 1024;
+    char buf[BLOCK + 2 * DISASM_TEXT];
+    char ea[DISASM_TEXT];
+    char *p = buf;
+    UINT32 lines = 0;
+
+    for (UINT32 addr = start; addr <= end; lines++){
+        char *line = p;
+        int length = Disasm::mem((WORD)addr, p);
+
+        while (*p != '\0'){
+            p++;
+        }
+        while (p < line + 13){
+            *p++ = ' ';
+        }
+        Disasm::unasm((WORD)addr, p, ea);
+        while (*p != '\0'){
+            p++;
+        }
+        *p++ = '\n';
+        if (p - buf >= BLOCK){
+            out.write(buf, p - buf);
+            p = buf;
+        }
+        addr += length;
+    }
+    out.write(buf, p - buf);
+
+    return (lines);
+}
+
+void Disasm::save_pr()
+{
+    pr[0] = cpu.getPC() + 1;
+    pr[1] = cpu.getP1();
+    pr[2] = cpu.getP2();
+    pr[3] = cpu.getP3();
+}
+
+WORD Disasm::disasm_ea(WORD addr, int addressing, SBYTE disp)
+{
+    WORD ptr, ea;
+
+    ptr = pr[addressing & BIT_OPCODE_PR];
+
+    if (disp == -128){
+        disp = cpu.getER();
+    }
+    if ((addressing & BIT_OPCODE_MODE) == 0){      // Indexed Addressing
+        ea = (ptr & BIT_PR_PAGE) | ((ptr + disp) & ~BIT_PR_PAGE);
+    }
+    else {                                  // Auto-Indexed Addressing
+        if (disp < 0){
+            ea = (ptr & BIT_PR_PAGE) | ((ptr + disp + 1) & ~BIT_PR_PAGE);
+        }
+        else {
+            ea = ptr;
+        }
+    }
+    return (ea);
+}
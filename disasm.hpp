@@ -1,33 +1,60 @@
-#ifndef DISASM_HPP
-#define DISASM_HPP
-
-#include <string>
-#include "common.h"
-#include "memory.hpp"
-#include "cpu.hpp"
-
-class Disasm {
-
-public:
-    Disasm(Memory& mem, CPU &cpu);
-    std::string mem(WORD addr);
-    void unasm(WORD addr, std::string &assembler, std::string &ea);
-    void save_pr();
-
-private:
-    Memory &memory;
-    CPU &cpu;
-
-    WORD pr[4];
-
-    void disasm(BYTE opcode, std::string &assembler);
-    void disasm(WORD addr, BYTE opcode, SBYTE operand, std::string &assembler, std::string &ea);
-    WORD disasm_ea(WORD addr, int addressing, SBYTE disp);
-    std::string operandPR(BYTE opcode);
-    std::string operand_str(SBYTE operand, int base);
-    std::string operand_addressing(int addressing, SBYTE operand);
-    std::string ea_jump(WORD addr, int addressing, SBYTE operand);
-    std::string ea_memory(WORD addr, int addressing, SBYTE operand);
-};
-
-#endif
\ No newline at end of file
+#ifndef DISASM_HPP
+#define DISASM_HPP
+
+#include <string>
+#include <ostream>
+#include "common.h"
+#include "memory.hpp"
+#include "cpu.hpp"
+
+// operand classes of opcodes
+enum DisasmClass {
+    DIS_UND,            // undefined (length by BIT_SIGN_BYTE)
+    DIS_NONE,           // no operand
+    DIS_PTR,            // pointer register: XPAL, XPAH, XPPC
+    DIS_COUNT,          // decimal count: DLY
+    DIS_JUMP,           // disp(Pn), EA is the target
+    DIS_MEMORY,         // [@]disp(Pn), EA and its data
+    DIS_IMMEDIATE       // data byte
+};
+
+// what the disassembler knows of an opcode
+struct DisasmInfo {
+    const char *mnemonic;
+    BYTE length;            // bytes
+    BYTE cls;               // DisasmClass
+    BYTE pr;                // pointer register
+    bool autoindex;         // @disp(Pn)
+};
+
+// buffer of unasm() and mem() (NUL terminated)
+const int DISASM_TEXT = 32;
+
+class Disasm {
+
+public:
+    Disasm(Memory& mem, CPU &cpu);
+    std::string mem(WORD addr);
+    void unasm(WORD addr, std::string &assembler, std::string &ea);
+    void save_pr();
+    std::string mnemonic(BYTE opcode);
+
+    // into caller buffers of DISASM_TEXT bytes, returns the length of the instruction
+    int mem(WORD addr, char *buf);
+    int unasm(WORD addr, char *assembler, char *ea);
+
+    // listing of U from start to end (the last instruction may go past end), returns lines
+    UINT32 list(std::ostream &out, WORD start, WORD end);
+
+    static const DisasmInfo &info(BYTE opcode);
+
+private:
+    Memory &memory;
+    CPU &cpu;
+
+    WORD pr[4];
+
+    WORD disasm_ea(WORD addr, int addressing, SBYTE disp);
+};
+
+#endif
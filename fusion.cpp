@@ -0,0 +1,109 @@
+#include "common.h"
+#include "memory.hpp"
+#include "io.hpp"
+#include "cpu.hpp"
+#include "hle.hpp"
+
+// address in the page of base (as CPU::calc_ea)
+static inline WORD page_ea(WORD base, int disp)
+{
+    return ((base & BIT_PR_PAGE) | ((base + disp) & ~BIT_PR_PAGE));
+}
+
+//
+// Superinstructions: frequent opcode sequences executed by one dispatch.
+//
+// Candidates are the top opcode bigrams of the bench workloads:
+//   LD @d(Pn)  ST d(Pm)                    block copy
+//   DLD d(Pn)  JNZ d                       countdown loop
+//   LDI lo  XPAL Pn  LDI hi  XPAH Pn       pointer load
+//   LDI n  XPAL Pn / XPAH Pn               half of a pointer load
+//
+// run() calls this only when the opcode at PC + 1 is fusible(). The result
+// (registers, memory, counters and the loop hint) is the same as executing
+// the instructions one by one. A sequence is not fused when an interrupt
+// is pending, when memory is watched, when it does not fit in the limits,
+// when an HLE trap is set inside it or when DLD would modify the JNZ.
+//
+bool CPU::exec_fused(UINT64 insts_limit, UINT64 cycles_limit)
+{
+    if ((reg.SR & BIT_SR_IE) != 0 && (reg.SR & BIT_SR_SA) != 0){    // interrupt is pending
+        return (false);
+    }
+    if (memory.watched()){
+        return (false);             // fetches must be seen one by one
+    }
+
+    WORD pc = reg.PR[0];
+    BYTE op1 = memory.peek(page_ea(pc, 1));
+    SBYTE disp1 = memory.peek(page_ea(pc, 2));
+    BYTE op2 = memory.peek(page_ea(pc, 3));
+    SBYTE disp2 = memory.peek(page_ea(pc, 4));
+    int pr = op2 & BIT_OPCODE_PR;
+    int insts_fused = 2;
+    UINT32 cycles_fused = cycle_table[op1] + cycle_table[op2];
+
+    if (op1 == OPE_LDI && (op2 & 0xf8) == OPE_XPAL && pr != 0){
+        if (op2 == (OPE_XPAL | pr) && (BYTE)disp2 == OPE_LDI && memory.peek(page_ea(pc, 6)) == (OPE_XPAH | pr)){
+            insts_fused = 4;
+            cycles_fused += cycle_table[OPE_LDI] + cycle_table[OPE_XPAH];
+        }
+    }
+    else if ((op1 & ~BIT_OPCODE_PR) == (OPE_LD | BIT_OPCODE_MODE) && op1 != OPE_LDI &&
+             (op2 & 0xf8) == OPE_ST && op2 != (OPE_ST | BIT_OPCODE_MODE)){
+        // LD @d(Pn), ST
+    }
+    else if ((op1 & 0xfc) == OPE_DLD && (op2 & 0xfc) == OPE_JNZ){
+        int dld_pr = op1 & BIT_OPCODE_PR;
+        WORD ea = page_ea((dld_pr == 0) ? page_ea(pc, 2) : reg.PR[dld_pr], disp1);
+        if (ea == page_ea(pc, 3) || ea == page_ea(pc, 4)){
+            return (false);         // DLD modifies the JNZ
+        }
+    }
+    else {
+        return (false);
+    }
+
+    // conditional jump: taken
+    if (insts + insts_fused > insts_limit || cycles + cycles_fused + 2 > cycles_limit){
+        return (false);
+    }
+    if (CPU::is_entry(page_ea(pc, 3), ENTRY_HLE) ||
+        (insts_fused == 4 && (CPU::is_entry(page_ea(pc, 4), ENTRY_HLE) || CPU::is_entry(page_ea(pc, 6), ENTRY_HLE)))){
+        return (false);
+    }
+
+    if (op1 == OPE_LDI){                // LDI, XPAL/XPAH [, LDI, XPAH]
+        if (insts_fused == 4){
+            reg.AC = reg.PR[pr] >> 8;
+            reg.PR[pr] = (memory.peek(page_ea(pc, 5)) << 8) | (BYTE)disp1;
+            reg.PR[0] = page_ea(pc, 6);
+        }
+        else if ((op2 & ~BIT_OPCODE_PR) == OPE_XPAL){
+            reg.AC = reg.PR[pr] & 0x00ff;
+            reg.PR[pr] = (reg.PR[pr] & 0xff00) | (BYTE)disp1;
+            reg.PR[0] = page_ea(pc, 3);
+        }
+        else {
+            reg.AC = reg.PR[pr] >> 8;
+            reg.PR[pr] = (reg.PR[pr] & 0x00ff) | ((BYTE)disp1 << 8);
+            reg.PR[0] = page_ea(pc, 3);
+        }
+    }
+    else if ((op1 & 0xfc) == OPE_DLD){  // DLD, JNZ
+        reg.PR[0] = page_ea(pc, 2);
+        CPU::execDLD(op1, disp1);
+        reg.PR[0] = page_ea(pc, 4);
+        CPU::execJNZ(op2, disp2);
+    }
+    else {                              // LD @d(Pn), ST
+        reg.PR[0] = page_ea(pc, 4);
+        reg.AC = memory.read(CPU::get_ea(op1 & (BIT_OPCODE_MODE | BIT_OPCODE_PR), disp1));
+        memory.write(CPU::get_ea(op2 & (BIT_OPCODE_MODE | BIT_OPCODE_PR), disp2), reg.AC);
+    }
+    insts += insts_fused;
+    cycles += cycles_fused;
+    fused++;
+
+    return (true);
+}
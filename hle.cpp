@@ -0,0 +1,288 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+#include "common.h"
+#include "util.hpp"
+#include "memory.hpp"
+#include "io.hpp"
+#include "cpu.hpp"
+#include "hle.hpp"
+
+// address in the page of base (as CPU::calc_ea)
+static inline WORD page_ea(WORD base, int disp)
+{
+    return ((base & BIT_PR_PAGE) | ((base + disp) & ~BIT_PR_PAGE));
+}
+
+// binary add with carry, CY and OV to sr (as CPU::add_byte)
+static inline BYTE add_byte(BYTE &sr, BYTE a, BYTE b)
+{
+    WORD c = (WORD)a + (WORD)b + ((sr & BIT_SR_CY) == 0 ? 0: 1);
+
+    sr = (sr & ~(BIT_SR_CY | BIT_SR_OV)) | ((c & 0x0100) >> 1);
+    if (((a & BIT_SIGN_BYTE) == (b & BIT_SIGN_BYTE)) && ((a & BIT_SIGN_BYTE) != (c & BIT_SIGN_BYTE))){
+        sr |= BIT_SR_OV;
+    }
+    return ((BYTE)c);
+}
+
+//
+// mul8: 8 x 8 bit shift-and-add multiply of bench/mul.srec
+//
+//   in:  0(P2) multiplicand, 1(P2) multiplier
+//   out: 3(P2):2(P2) product, 1(P2) = 4(P2) = 0, AC = 0, CY/OV of the last add
+//   returns with XPPC P3 at entry + 0x32
+//
+static bool mul8(HLECall &call)
+{
+    CPU &cpu = call.cpu;
+    Memory &memory = call.memory;
+    WORD p2 = cpu.getP2();
+    BYTE a = memory.read(page_ea(p2, 0));
+    BYTE b = memory.read(page_ea(p2, 1));
+    int ones = 0;
+
+    for (BYTE bit = 0x80; bit != 0; bit >>= 1){
+        ones += ((b & bit) != 0) ? 1 : 0;
+    }
+
+    // LDI ST ST LDI ST, 8 x (CCL LD ADD ST LD ADD ST CCL LD ADD ST CSA JP DLD JNZ), XPPC
+    // adding: CCL LD ADD ST LD ADI ST
+    call.insts = 5 + 8 * 15 + 7 * ones + 1;
+    call.cycles = 74 + 8 * 220 + 2 * (8 - ones) + 2 * 7 + 107 * ones + 7;
+    if (call.insts > call.insts_left || call.cycles > call.cycles_left){
+        return (false);
+    }
+
+    BYTE sr = cpu.getSR();
+    BYTE lo = 0, hi = 0;
+    for (int i = 0; i < 8; i++){
+        sr &= ~BIT_SR_CY;
+        lo = add_byte(sr, lo, lo);
+        hi = add_byte(sr, hi, hi);
+        sr &= ~BIT_SR_CY;
+        b = add_byte(sr, b, b);
+        if ((sr & BIT_SR_CY) != 0){
+            sr &= ~BIT_SR_CY;
+            lo = add_byte(sr, lo, a);
+            hi = add_byte(sr, hi, 0);
+        }
+    }
+    memory.write(page_ea(p2, 1), b);
+    memory.write(page_ea(p2, 2), lo);
+    memory.write(page_ea(p2, 3), hi);
+    memory.write(page_ea(p2, 4), 0);
+    cpu.setAC(0);
+    cpu.setSR(sr);
+    cpu.setPC(cpu.getP3());
+    cpu.setP3(page_ea(call.entry, 0x32));
+
+    return (true);
+}
+
+// native routines by name
+static const struct {
+    const char *name;
+    HLEHandler handler;
+} handlers[] = {
+    {"mul8", mul8},
+};
+
+HLE::HLE()
+{
+    verify = false;
+    HLE::clear();
+}
+
+void HLE::clear()
+{
+    traps.clear();
+}
+
+HLEHandler HLE::find_handler(const std::string &name)
+{
+    for (auto &h : handlers){
+        if (name == h.name){
+            return (h.handler);
+        }
+    }
+    return (nullptr);
+}
+
+// FNV-1a
+UINT32 HLE::hash(Memory &memory, WORD addr, WORD length)
+{
+    UINT32 h = 2166136261U;
+
+    for (WORD i = 0; i < length; i++){
+        h = (h ^ memory.peek(addr + i)) * 16777619U;
+    }
+    return (h);
+}
+
+//
+// description file: one trap per line, '#' starts a comment
+//
+//   entry length hash handler      (hex, hex, hex, name)
+//
+// A trap whose hash does not match the loaded code is not armed.
+//
+bool HLE::load(const std::string &filename, Memory &memory)
+{
+    std::ifstream file;
+    std::string line;
+    int lines = 0;
+
+    file.open(filename);
+    if (file.fail()){
+        std::cout << "File not found!(" << filename << ")" << std::endl;
+        return (false);
+    }
+    while (getline(file, line)){
+        lines++;
+        line = line.substr(0, line.find('#'));
+
+        std::stringstream ss(line);
+        std::string entry, length, hash, name;
+        if (!(ss >> entry)){
+            continue;           // blank line
+        }
+        if (!(ss >> length >> hash >> name)){
+            std::cout << filename << ":" << lines << ": syntax error" << std::endl;
+            return (false);
+        }
+
+        HLETrap trap;
+        trap.entry = strtoul(entry.c_str(), nullptr, 16);
+        trap.length = strtoul(length.c_str(), nullptr, 16);
+        trap.hash = strtoul(hash.c_str(), nullptr, 16);
+        trap.name = name;
+        trap.handler = HLE::find_handler(name);
+        trap.hits = 0;
+        trap.armed = true;
+        trap.checked = 0;
+        if (trap.handler == nullptr){
+            std::cout << filename << ":" << lines << ": unknown handler(" << name << ")" << std::endl;
+            return (false);
+        }
+        if (HLE::find(trap.entry) != nullptr){
+            std::cout << filename << ":" << lines << ": " << name << " at " << Util::hex2str(trap.entry) << " is already trapped" << std::endl;
+            return (false);
+        }
+
+        UINT32 actual = HLE::hash(memory, trap.entry, trap.length);
+        if (actual != trap.hash){
+            std::stringstream hex;
+            hex << std::hex << actual;
+            std::cout << filename << ":" << lines << ": " << name << " at " << Util::hex2str(trap.entry);
+            std::cout << " hash mismatch(" << hex.str() << "), not armed" << std::endl;
+            continue;
+        }
+        traps.insert(std::lower_bound(traps.begin(), traps.end(), trap,
+                                      [](const HLETrap &a, const HLETrap &b){return (a.entry < b.entry);}), trap);
+    }
+    file.close();
+
+    std::cout << filename << "(" << traps.size() << " traps)" << std::endl;
+
+    return (true);
+}
+
+UINT64 HLE::hits()
+{
+    UINT64 total = 0;
+
+    for (auto &trap : traps){
+        total += trap.hits;
+    }
+    return (total);
+}
+
+HLETrap *HLE::trap_at(WORD entry)
+{
+    auto it = std::lower_bound(traps.begin(), traps.end(), entry,
+                               [](const HLETrap &trap, WORD entry){return (trap.entry < entry);});
+
+    return ((it == traps.end() || it->entry != entry) ? nullptr : &*it);
+}
+
+bool HLE::trap(CPU &cpu, Memory &memory, UINT64 insts_left, UINT64 cycles_left, CPUSTAT &status)
+{
+    WORD entry = page_ea(cpu.getPC(), 1);
+    HLETrap &trap = *HLE::trap_at(entry);
+    HLECall call = {cpu, memory, entry, insts_left, cycles_left, 0, 0};
+
+    if (!trap.armed){
+        return (false);
+    }
+    if ((cpu.getSR() & BIT_SR_IE) != 0 && (cpu.getSR() & BIT_SR_SA) != 0){     // interrupt comes first
+        return (false);
+    }
+    if (trap.checked != memory.generation()){          // code may have been written since
+        if (HLE::hash(memory, trap.entry, trap.length) != trap.hash){
+            return (false);
+        }
+        trap.checked = memory.generation();
+    }
+
+    status = SUCCESS;
+    if (verify){
+        return (HLE::compare(trap, call, status));
+    }
+    if (!trap.handler(call)){
+        return (false);
+    }
+    cpu.advance(call.insts, call.cycles);
+    trap.hits++;
+
+    return (true);
+}
+
+// run the handler on a copy, interpret the routine, and disarm the trap if they differ
+bool HLE::compare(HLETrap &trap, HLECall &call, CPUSTAT &status)
+{
+    CPU &cpu = call.cpu;
+    Memory &memory = call.memory;
+    Memory native_memory = memory;
+    CPU native(native_memory);
+
+    native_memory.set_watch(nullptr);
+
+    native.setAC(cpu.getAC());
+    native.setER(cpu.getER());
+    native.setSR(cpu.getSR());
+    native.setPC(cpu.getPC());
+    native.setP1(cpu.getP1());
+    native.setP2(cpu.getP2());
+    native.setP3(cpu.getP3());
+
+    HLECall native_call = {native, native_memory, call.entry, call.insts_left, call.cycles_left, 0, 0};
+    if (!trap.handler(native_call)){
+        return (false);
+    }
+
+    UINT64 cycles = cpu.get_cycles();
+    for (UINT64 i = 0; i < native_call.insts && status == SUCCESS; i++){
+        status = cpu.clock();
+    }
+
+    bool match = (status == SUCCESS) && cpu.get_cycles() - cycles == native_call.cycles &&
+                 cpu.getAC() == native.getAC() && cpu.getER() == native.getER() && cpu.getSR() == native.getSR() &&
+                 cpu.getPC() == native.getPC() && cpu.getP1() == native.getP1() &&
+                 cpu.getP2() == native.getP2() && cpu.getP3() == native.getP3();
+    for (int addr = 0; addr <= 0xffff && match; addr++){
+        match = (memory.read(addr) == native_memory.read(addr));
+    }
+
+    if (match){
+        trap.hits++;
+    }
+    else {
+        std::cerr << "HLE " << trap.name << " at " << Util::hex2str(trap.entry) << ": native result differs, not armed" << std::endl;
+        trap.armed = false;
+    }
+    return (true);
+}
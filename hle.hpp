@@ -0,0 +1,65 @@
+#ifndef HLE_HPP
+#define HLE_HPP
+
+#include <string>
+#include <vector>
+#include "common.h"
+#include "memory.hpp"
+#include "cpu.hpp"
+
+// a native routine replacing SC/MP code
+struct HLECall {
+    CPU &cpu;
+    Memory &memory;
+    WORD entry;
+    UINT64 insts_left;      // in:  budget of run()
+    UINT64 cycles_left;
+    UINT64 insts;           // out: instructions the routine would execute
+    UINT64 cycles;          // out: micro cycles
+};
+
+// return false without side effects when the call is not handled
+typedef bool (*HLEHandler)(HLECall &call);
+
+// entry of trap table
+struct HLETrap {
+    WORD entry;             // first instruction of the routine
+    WORD length;            // bytes covered by hash
+    UINT32 hash;            // FNV-1a of the code
+    std::string name;
+    HLEHandler handler;
+    UINT64 hits;
+    bool armed;             // false: disarmed by verification
+    UINT64 checked;         // Memory::generation() the hash matched in (0: none)
+};
+
+// high-level emulation: traps at routine entries, verified by code hash
+class HLE {
+public:
+    HLE();
+
+    bool load(const std::string &filename, Memory &memory);    // description file
+    void clear();
+    inline bool empty(){return (traps.empty());};
+    inline void set_verify(bool flag){verify = flag;};     // run both and compare
+    UINT64 hits();
+
+    // traps by entry (run() finds them by ENTRY_HLE of the entry map)
+    inline const std::vector<HLETrap> &list(){return (traps);};
+    inline const HLETrap *find(WORD entry){return (HLE::trap_at(entry));};
+
+    // routine at PC + 1 executed natively (false: interpret as usual)
+    bool trap(CPU &cpu, Memory &memory, UINT64 insts_left, UINT64 cycles_left, CPUSTAT &status);
+
+    static UINT32 hash(Memory &memory, WORD addr, WORD length);
+    static HLEHandler find_handler(const std::string &name);
+
+private:
+    std::vector<HLETrap> traps;         // sorted by entry
+    bool verify;
+
+    HLETrap *trap_at(WORD entry);      // nullptr: none
+    bool compare(HLETrap &trap, HLECall &call, CPUSTAT &status);
+};
+
+#endif
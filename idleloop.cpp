@@ -0,0 +1,140 @@
+#include "common.h"
+#include "memory.hpp"
+#include "io.hpp"
+#include "cpu.hpp"
+
+// longest loop body to be examined (bytes)
+const int LOOP_BODY_MAX = 16;
+
+//
+// Skip iterations of an idle loop just closed by a backward jump.
+//
+// Countdown loop:  [LDI n | DLY n | NOP]...  DLD d(Pn)  JNZ loop
+//   every DLY must follow an LDI in the body, so that each iteration
+//   takes the same cycles. The loop ends when the counter becomes 0.
+// Polling loop:    CSA  ANI mask  JZ/JNZ loop      (mask in SA|SB)
+//   repeats until a sense input changes, i.e. until cycles_limit,
+//   which Machine sets to the next external event.
+//
+// Only whole iterations ending with the jump taken are skipped, not
+// beyond the point where run() stops and not over a breakpoint, so the
+// result is the same as executing them one by one.
+//
+void CPU::skip_loop(UINT64 insts_limit, UINT64 cycles_limit)
+{
+    UINT32 &reject = loop_reject[loop_jump % (sizeof(loop_reject) / sizeof(loop_reject[0]))];
+    WORD top = calc_ea(0, 1);           // first instruction of the loop
+    WORD jump = loop_jump;
+    BYTE jump_op = memory.peek(jump);
+
+    if ((reg.SR & BIT_SR_IE) != 0 && (reg.SR & BIT_SR_SA) != 0){    // interrupt is pending
+        return;
+    }
+    if (reject == (UINT32)jump + 1 || cycles >= cycles_limit){
+        return;
+    }
+    if (top >= jump || jump - top > LOOP_BODY_MAX || (top & BIT_PR_PAGE) != (jump & BIT_PR_PAGE) ||
+        (jump_op != OPE_JZ && jump_op != OPE_JNZ)){
+        reject = (UINT32)jump + 1;
+        return;
+    }
+
+    UINT64 iterations;                  // iterations which can be skipped
+    UINT64 iter_insts = 1;              // instructions of an iteration
+    UINT64 iter_cycles = cycle_table[jump_op] + 2;
+    bool countdown = false;
+    WORD counter = 0;                   // address of the counter
+
+    BYTE mask = memory.peek(top + 2);
+    if (jump - top == 3 && memory.peek(top) == OPE_CSA && memory.peek(top + 1) == OPE_ANI &&
+        mask != 0 && (mask & ~(BIT_SR_SA | BIT_SR_SB)) == 0){
+        // polling loop: nothing changes but time
+        if (insts_limit == ~0ULL && cycles_limit == ~0ULL){
+            return;
+        }
+        if (((reg.SR & mask) != 0) != (jump_op == OPE_JNZ)){     // sense changed during the iteration
+            return;
+        }
+        iterations = ~0ULL;
+        iter_insts += 2;
+        iter_cycles += cycle_table[OPE_CSA] + cycle_table[OPE_ANI];
+    }
+    else if (jump_op == OPE_JNZ){
+        BYTE ac = 0;
+        bool ac_loaded = false;
+        WORD addr = top;
+
+        while (addr < jump && !countdown){
+            BYTE opcode = memory.peek(addr);
+            BYTE operand = memory.peek(addr + 1);
+
+            iter_insts++;
+            iter_cycles += cycle_table[opcode];
+            if (opcode == OPE_NOP){
+                addr++;
+            }
+            else if (opcode == OPE_LDI){
+                ac = operand;
+                ac_loaded = true;
+                addr += 2;
+            }
+            else if (opcode == OPE_DLY && ac_loaded){
+                iter_cycles += 2 * (UINT32)ac + 2 * (UINT32)operand + ((UINT32)operand << 9);
+                addr += 2;
+            }
+            else if ((opcode & ~BIT_OPCODE_PR) == OPE_DLD && operand != 0x80 && addr + 2 == jump){   // not disp=ER
+                int pr = opcode & BIT_OPCODE_PR;
+                WORD base = (pr == 0) ? (WORD)(addr + 1) : reg.PR[pr];     // PC points to operand
+                counter = (base & BIT_PR_PAGE) | ((base + (SBYTE)operand) & ~BIT_PR_PAGE);
+                countdown = true;
+                addr += 2;
+            }
+            else {
+                break;
+            }
+        }
+        if (!countdown || (top <= counter && counter <= jump + 1)){     // self-modifying
+            reject = (UINT32)jump + 1;
+            return;
+        }
+
+        BYTE count = memory.read(counter);
+        if (count <= 1){
+            return;
+        }
+        iterations = count - 1;             // the last one falls through JNZ
+    }
+    else {
+        reject = (UINT32)jump + 1;
+        return;
+    }
+
+    // a breakpoint in the loop
+    for (int i = 0; i <= jump + 1 - top; i++){
+        if (CPU::is_entry((top & BIT_PR_PAGE) | ((top + i) & ~BIT_PR_PAGE), ENTRY_BREAK)){
+            return;
+        }
+    }
+
+    // stop no later than run() does
+    if (insts_limit != ~0ULL){
+        UINT64 n = (insts_limit - insts) / iter_insts;
+        iterations = (n < iterations) ? n : iterations;
+    }
+    if (cycles_limit != ~0ULL){
+        UINT64 n = (cycles_limit - cycles - 1) / iter_cycles;
+        iterations = (n < iterations) ? n : iterations;
+    }
+    if (iterations == 0){
+        return;
+    }
+
+    if (countdown){
+        BYTE count = memory.read(counter) - (BYTE)iterations;
+        memory.write(counter, count);
+        reg.AC = count;
+    }
+    insts += iterations * iter_insts;
+    cycles += iterations * iter_cycles;
+    skipped += iterations * iter_insts;
+}
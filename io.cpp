@@ -0,0 +1,494 @@
+#include <cstdio>
+#include <cctype>
+#include <cerrno>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include "common.h"
+#include "util.hpp"
+#include "io.hpp"
+
+//
+// IOChannel: base class (no input, output is discarded)
+//
+
+IOChannel::IOChannel()
+{
+    cooked = true;
+}
+
+int IOChannel::getc()
+{
+    int c = read_char();
+
+    if (c >= 0 && cooked){
+        c = IOChannel::cook(c);
+    }
+    return (c);
+}
+
+int IOChannel::cook(int c)
+{
+    c = std::toupper(c);
+    if (c == 0x0a){         // LF--> CR
+        c = 0x0d;
+    }
+    return (c);
+}
+
+int IOChannel::read_char()
+{
+    return (IO_EOF);
+}
+
+void IOChannel::putc(BYTE c)
+{
+}
+
+void IOChannel::write(const char *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++){
+        putc((BYTE)buf[i]);
+    }
+}
+
+void IOChannel::flush()
+{
+}
+
+bool IOChannel::wait_input()
+{
+    return (false);
+}
+
+//
+// StdoutChannel
+//
+
+StdoutChannel::StdoutChannel()
+{
+    length = 0;
+    line_flush = isatty(fileno(stdout));
+}
+
+StdoutChannel::~StdoutChannel()
+{
+    StdoutChannel::flush();
+}
+
+void StdoutChannel::putc(BYTE c)
+{
+    buffer[length++] = c;
+    if (length == IO_BUFSIZE || (line_flush && c == 0x0a)){
+        StdoutChannel::flush();
+    }
+}
+
+void StdoutChannel::write(const char *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++){
+        StdoutChannel::putc((BYTE)buf[i]);
+    }
+}
+
+void StdoutChannel::flush()
+{
+    if (length != 0){
+        fwrite(buffer, 1, length, stdout);
+        length = 0;
+    }
+    fflush(stdout);
+}
+
+//
+// TerminalChannel: stdin in non-canonical mode, read() never blocks
+//
+
+TerminalChannel::TerminalChannel(bool echo)
+{
+    raw = false;
+    eof = false;
+    inpos = inlen = 0;
+    outlen = 0;
+
+    if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &saved) == 0){
+        struct termios tio = saved;
+        tio.c_lflag &= ~ICANON;
+        if (!echo){
+            tio.c_lflag &= ~ECHO;
+        }
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        raw = (tcsetattr(STDIN_FILENO, TCSANOW, &tio) == 0);
+    }
+    else {
+        fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+    }
+}
+
+TerminalChannel::~TerminalChannel()
+{
+    TerminalChannel::flush();
+    if (raw){
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    }
+    else {
+        fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) & ~O_NONBLOCK);
+    }
+}
+
+int TerminalChannel::read_char()
+{
+    if (inpos == inlen){
+        if (eof){
+            return (IO_EOF);
+        }
+        ssize_t n = read(STDIN_FILENO, inbuf, sizeof(inbuf));
+        if (n > 0){
+            inpos = 0;
+            inlen = n;
+        }
+        else if (n == 0 && !raw){       // end of pipe or file
+            eof = true;
+            return (IO_EOF);
+        }
+        else if (n < 0 && errno != EAGAIN && errno != EINTR){
+            eof = true;
+            return (IO_EOF);
+        }
+        else {
+            return (IO_AGAIN);
+        }
+    }
+    return ((BYTE)inbuf[inpos++]);
+}
+
+void TerminalChannel::putc(BYTE c)
+{
+    outbuf[outlen++] = c;
+    if (outlen == IO_BUFSIZE || c == 0x0a){
+        TerminalChannel::flush();
+    }
+}
+
+void TerminalChannel::write(const char *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++){
+        TerminalChannel::putc((BYTE)buf[i]);
+    }
+}
+
+void TerminalChannel::flush()
+{
+    size_t pos = 0;
+
+    fflush(stdout);
+    while (pos < outlen){
+        ssize_t n = ::write(STDOUT_FILENO, outbuf + pos, outlen - pos);
+        if (n < 0 && errno != EINTR){
+            break;
+        }
+        if (n > 0){
+            pos += n;
+        }
+    }
+    outlen = 0;
+}
+
+bool TerminalChannel::wait_input()
+{
+    struct pollfd fds;
+
+    if (inpos != inlen){
+        return (true);
+    }
+    if (eof){
+        return (false);
+    }
+    TerminalChannel::flush();
+
+    fds.fd = STDIN_FILENO;
+    fds.events = POLLIN;
+    while (poll(&fds, 1, -1) < 0){
+        if (errno != EINTR){
+            return (false);
+        }
+    }
+    return (true);
+}
+
+//
+// StringChannel
+//
+
+StringChannel::StringChannel(const std::string &input): instr(input)
+{
+    inpos = 0;
+}
+
+int StringChannel::read_char()
+{
+    if (inpos == instr.length()){
+        return (IO_EOF);
+    }
+    return ((BYTE)instr[inpos++]);
+}
+
+void StringChannel::putc(BYTE c)
+{
+    outstr += (char)c;
+}
+
+void StringChannel::write(const char *buf, size_t len)
+{
+    outstr.append(buf, len);
+}
+
+void StringChannel::feed(const std::string &input)
+{
+    instr.erase(0, inpos);
+    inpos = 0;
+    instr += input;
+}
+
+//
+// FileChannel
+//
+
+FileChannel::FileChannel(FILE *fp): fp(fp)
+{
+    owner = false;
+}
+
+FileChannel::FileChannel(const std::string &filename, const char *mode)
+{
+    fp = fopen(filename.c_str(), mode);
+    owner = true;
+}
+
+FileChannel::~FileChannel()
+{
+    if (fp != nullptr){
+        if (owner){
+            fclose(fp);
+        }
+        else {
+            fflush(fp);
+        }
+    }
+}
+
+int FileChannel::read_char()
+{
+    int c = (fp == nullptr) ? EOF : fgetc(fp);
+
+    if (c == EOF && fp != nullptr && ferror(fp) && errno == EINTR){
+        clearerr(fp);               // signal (Machine::request_stop), not end of input
+        return (IO_AGAIN);
+    }
+    return (c == EOF ? IO_EOF : c);
+}
+
+void FileChannel::putc(BYTE c)
+{
+    if (fp != nullptr){
+        fputc(c, fp);
+    }
+}
+
+void FileChannel::write(const char *buf, size_t len)
+{
+    if (fp != nullptr){
+        fwrite(buf, 1, len, fp);
+    }
+}
+
+void FileChannel::flush()
+{
+    if (fp != nullptr){
+        fflush(fp);
+    }
+}
+
+//
+// InjectChannel
+//
+
+InjectChannel::InjectChannel()
+{
+    in = out = nullptr;
+    pos = 0;
+    IOChannel::set_cooked(false);       // queued text follows in->is_cooked()
+}
+
+void InjectChannel::attach(IOChannel *in, IOChannel *out)
+{
+    InjectChannel::in = in;
+    InjectChannel::out = out;
+}
+
+void InjectChannel::feed(const std::string &text)
+{
+    InjectChannel::text.erase(0, pos);
+    pos = 0;
+    InjectChannel::text += text;
+}
+
+int InjectChannel::read_char()
+{
+    if (!pending()){
+        return (in->getc());
+    }
+    int c = (BYTE)text[pos++];
+    if (pos == text.length()){
+        text.clear();
+        pos = 0;
+    }
+    return (in->is_cooked() ? IOChannel::cook(c) : c);
+}
+
+void InjectChannel::putc(BYTE c)
+{
+    if (!pending()){
+        out->putc(c);
+    }
+}
+
+void InjectChannel::write(const char *buf, size_t len)
+{
+    if (!pending()){
+        out->write(buf, len);
+    }
+}
+
+void InjectChannel::flush()
+{
+    if (!pending()){
+        out->flush();
+    }
+}
+
+bool InjectChannel::wait_input()
+{
+    return (pending() || in->wait_input());
+}
+
+//
+// AsyncChannel
+//
+
+// ring size rounded up to a power of 2 (index by mask)
+static size_t ring_size(size_t size)
+{
+    size_t n = 1;
+
+    while (n < size){
+        n <<= 1;
+    }
+    return (n);
+}
+
+AsyncChannel::AsyncChannel(IOChannel *sink, size_t size): sink(sink), ring(ring_size(size))
+{
+    mask = ring.size() - 1;
+    head = 0;
+    tail = 0;
+    written = 0;
+    sleeping = false;
+    stop = false;
+
+    sigset_t saved;
+    Util::block_stop_signals(&saved);          // signals wake the thread that runs the CPU
+    writer = std::thread(&AsyncChannel::drain, this);
+    Util::restore_signals(&saved);
+}
+
+AsyncChannel::~AsyncChannel()
+{
+    AsyncChannel::flush();
+
+    stop = true;
+    AsyncChannel::wakeup();
+    writer.join();
+}
+
+void AsyncChannel::putc(BYTE c)
+{
+    size_t h = head.load(std::memory_order_relaxed);
+
+    while (h - tail.load(std::memory_order_acquire) > mask){    // ring is full
+        AsyncChannel::wakeup();
+        std::this_thread::yield();
+    }
+    ring[h & mask] = c;
+    head.store(h + 1, std::memory_order_release);
+
+    if (sleeping.load()){
+        AsyncChannel::wakeup();
+    }
+}
+
+void AsyncChannel::write(const char *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++){
+        AsyncChannel::putc((BYTE)buf[i]);
+    }
+}
+
+void AsyncChannel::flush()
+{
+    size_t target = head.load();
+
+    if (written.load() == target){
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mtx);
+    cv_data.notify_one();
+    cv_done.wait(lock, [&]{return (written.load() >= target);});
+}
+
+void AsyncChannel::wakeup()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    cv_data.notify_one();
+}
+
+void AsyncChannel::drain()
+{
+    while (1){
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_acquire);
+
+        if (t == h){
+            std::unique_lock<std::mutex> lock(mtx);
+            sleeping = true;
+            // sleeping is only a hint for putc(), so do not sleep too long
+            cv_data.wait_for(lock, std::chrono::milliseconds(10), [&]{return (head.load() != tail.load() || stop.load());});
+            sleeping = false;
+            if (head.load() == tail.load() && stop.load()){
+                break;
+            }
+            continue;
+        }
+
+        // write everything available, in at most two pieces at the wrap point
+        while (t != h){
+            size_t pos = t & mask;
+            size_t len = std::min(h - t, ring.size() - pos);
+            sink->write(&ring[pos], len);
+            t += len;
+            tail.store(t, std::memory_order_release);
+        }
+        sink->flush();
+
+        std::lock_guard<std::mutex> lock(mtx);
+        written = t;
+        cv_done.notify_all();
+    }
+}
@@ -0,0 +1,175 @@
+#ifndef IO_HPP
+#define IO_HPP
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <termios.h>
+#include "common.h"
+
+// result of IOChannel::getc() when no character is returned
+const int IO_EOF   = -1;    // end of input
+const int IO_AGAIN = -2;    // no input available yet
+
+// size of output buffer
+const size_t IO_BUFSIZE = 4096;
+
+// character I/O channel used by GETC/PUTC
+class IOChannel {
+public:
+    IOChannel();
+    virtual ~IOChannel(){};
+
+    int getc();                                 // read_char() + console translation
+    virtual int read_char();                    // raw character, IO_EOF or IO_AGAIN
+    virtual void putc(BYTE c);
+    virtual void write(const char *buf, size_t len);
+    virtual void flush();
+    virtual bool wait_input();                  // wait until input arrives (false: end of input)
+
+    // toupper() and LF->CR on input (for NIBL)
+    inline void set_cooked(bool flag){cooked = flag;};
+    inline bool is_cooked(){return (cooked);};
+
+protected:
+    static int cook(int c);
+
+private:
+    bool cooked;
+};
+
+// buffered writer to stdout
+class StdoutChannel : public IOChannel {
+public:
+    StdoutChannel();
+    ~StdoutChannel();
+
+    void putc(BYTE c);
+    void write(const char *buf, size_t len);
+    void flush();
+
+private:
+    char buffer[IO_BUFSIZE];
+    size_t length;
+    bool line_flush;        // flush at each LF (stdout is a terminal)
+};
+
+// raw-mode non-blocking terminal
+class TerminalChannel : public IOChannel {
+public:
+    TerminalChannel(bool echo = true);
+    ~TerminalChannel();
+
+    int read_char();
+    void putc(BYTE c);
+    void write(const char *buf, size_t len);
+    void flush();
+    bool wait_input();
+
+private:
+    struct termios saved;
+    bool raw;               // terminal attribute changed
+    bool eof;
+    char inbuf[256];
+    size_t inpos, inlen;
+    char outbuf[IO_BUFSIZE];
+    size_t outlen;
+};
+
+// in-memory string buffer
+class StringChannel : public IOChannel {
+public:
+    StringChannel(const std::string &input = "");
+
+    int read_char();
+    void putc(BYTE c);
+    void write(const char *buf, size_t len);
+
+    void feed(const std::string &input);
+    inline const std::string &output(){return (outstr);};
+    inline void clear_output(){outstr.clear();};
+
+private:
+    std::string instr;
+    size_t inpos;
+    std::string outstr;
+};
+
+// file or pipe (stdio stream)
+class FileChannel : public IOChannel {
+public:
+    FileChannel(FILE *fp);
+    FileChannel(const std::string &filename, const char *mode);
+    ~FileChannel();
+
+    inline bool is_open(){return (fp != nullptr);};
+
+    int read_char();
+    void putc(BYTE c);
+    void write(const char *buf, size_t len);
+    void flush();
+
+private:
+    FILE *fp;
+    bool owner;             // fclose() at destruction
+};
+
+// queued text served ahead of another input channel, output muted meanwhile
+class InjectChannel : public IOChannel {
+public:
+    InjectChannel();
+
+    void attach(IOChannel *in, IOChannel *out);
+    void feed(const std::string &text);
+    inline bool pending(){return (pos < text.length());};
+
+    int read_char();
+    void putc(BYTE c);
+    void write(const char *buf, size_t len);
+    void flush();
+    bool wait_input();
+
+private:
+    IOChannel *in;
+    IOChannel *out;
+    std::string text;
+    size_t pos;
+};
+
+// output through a lock-free SPSC ring drained by a writer thread
+class AsyncChannel : public IOChannel {
+public:
+    AsyncChannel(IOChannel *sink, size_t size = 64 * 1024);     // size: rounded up to a power of 2
+    ~AsyncChannel();
+
+    void putc(BYTE c);
+    void write(const char *buf, size_t len);
+    void flush();           // return after all data is written to sink
+
+    inline IOChannel *get_sink(){return (sink);};
+
+private:
+    IOChannel *sink;
+    std::vector<char> ring;
+    size_t mask;
+
+    std::atomic<size_t> head;       // next write position (CPU thread)
+    std::atomic<size_t> tail;       // next read position (writer thread)
+    std::atomic<size_t> written;    // flushed to sink up to here
+    std::atomic<bool> sleeping;     // writer is waiting for data
+    std::atomic<bool> stop;
+
+    std::mutex mtx;
+    std::condition_variable cv_data;
+    std::condition_variable cv_done;
+    std::thread writer;
+
+    void wakeup();
+    void drain();           // writer thread
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <new>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "common.h"
+#include "memory.hpp"
+#include "cpu.hpp"
+#include "live.hpp"
+
+LiveView::LiveView()
+{
+    header = nullptr;
+}
+
+LiveView::~LiveView()
+{
+    if (header != nullptr){
+        munmap(header, LIVE_SIZE);
+        shm_unlink(name.c_str());
+    }
+}
+
+bool LiveView::open(const std::string &shm_name)
+{
+    name = (shm_name[0] == '/') ? shm_name : "/" + shm_name;
+
+    // never truncate the view of another process
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 && errno == EEXIST){
+        std::cerr << "Live view exists!(/dev/shm" << name << ", in use or left by a crash: remove it to reuse the name)" << std::endl;
+        return (false);
+    }
+    if (fd < 0){
+        std::cerr << "shm_open() ERROR!!(" << name << ": " << strerror(errno) << ")" << std::endl;
+        return (false);
+    }
+    if (ftruncate(fd, LIVE_SIZE) < 0){
+        std::cerr << "ftruncate() ERROR!!(" << name << ")" << std::endl;
+        close(fd);
+        shm_unlink(name.c_str());
+        return (false);
+    }
+    void *region = mmap(nullptr, LIVE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED){
+        std::cerr << "mmap() ERROR!!(" << name << ")" << std::endl;
+        shm_unlink(name.c_str());
+        return (false);
+    }
+
+    header = new (region) LiveHeader();
+    memcpy(header->magic, "SCMPLIVE", sizeof(header->magic));
+    header->version = LIVE_VERSION;
+    header->memory_offset = LIVE_MEMORY_OFFSET;
+    header->regs.seq.store(0);
+    header->regs.status = LIVE_RUNNING;
+
+    return (true);
+}
+
+// seqlock writer: readers never block the CPU thread
+void LiveView::publish(CPU &cpu, UINT32 status)
+{
+    LiveRegs &regs = header->regs;
+    UINT32 seq = regs.seq.load(std::memory_order_relaxed);
+
+    regs.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    regs.status = status;
+    regs.insts = cpu.get_insts();
+    regs.cycles = cpu.get_cycles();
+    regs.PC = cpu.getPC();
+    regs.P1 = cpu.getP1();
+    regs.P2 = cpu.getP2();
+    regs.P3 = cpu.getP3();
+    regs.AC = cpu.getAC();
+    regs.ER = cpu.getER();
+    regs.SR = cpu.getSR();
+    regs.seq.store(seq + 2, std::memory_order_release);
+}
@@ -0,0 +1,66 @@
+#ifndef LIVE_HPP
+#define LIVE_HPP
+
+#include <string>
+#include <atomic>
+#include "common.h"
+#include "memory.hpp"
+#include "cpu.hpp"
+
+//
+// live view of a running machine in POSIX shared memory (scmp2.exe --live NAME)
+//
+//   /dev/shm/NAME holds a 4 KB header and the 64 KB memory of the machine,
+//   which runs directly in the region. Other processes map it read-only.
+//   Registers are published by Machine::run() between slices and when it
+//   stops, under a sequence counter (seqlock). A reader retries while the
+//   counter is odd or changed during its copy:
+//
+//       do {
+//           s1 = seq (acquire);
+//           copy registers;
+//           (acquire fence) s2 = seq;
+//       } while ((s1 & 1) != 0 || s1 != s2);
+//
+
+const UINT32 LIVE_VERSION = 1;
+const size_t LIVE_MEMORY_OFFSET = 4096;
+const size_t LIVE_SIZE = LIVE_MEMORY_OFFSET + 64 * 1024;
+
+// status while the machine runs (else the CPUSTAT of the last stop)
+const UINT32 LIVE_RUNNING = 0xffffffff;
+
+struct LiveRegs {
+    std::atomic<UINT32> seq;        // odd while written
+    UINT32 status;
+    UINT64 insts;
+    UINT64 cycles;
+    WORD PC, P1, P2, P3;
+    BYTE AC, ER, SR;
+};
+
+// offset 0 of the region
+struct LiveHeader {
+    char magic[8];                  // "SCMPLIVE"
+    UINT32 version;                 // LIVE_VERSION
+    UINT32 memory_offset;           // LIVE_MEMORY_OFFSET
+    LiveRegs regs;
+};
+
+class LiveView {
+public:
+    LiveView();
+    ~LiveView();                    // unmapped and unlinked
+
+    bool open(const std::string &name);      // created (false: it exists)
+    inline bool is_open(){return (header != nullptr);};
+    inline BYTE *memory(){return ((BYTE *)header + LIVE_MEMORY_OFFSET);};
+
+    void publish(CPU &cpu, UINT32 status);
+
+private:
+    std::string name;
+    LiveHeader *header;
+};
+
+#endif
@@ -0,0 +1,499 @@
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include "common.h"
+#include "memory.hpp"
+#include "io.hpp"
+#include "cpu.hpp"
+#include "hle.hpp"
+#include "memo.hpp"
+#include "aot.hpp"
+#include "opstats.hpp"
+#include "machine.hpp"
+
+Machine::Machine(): cpu(memory), memo(memory), console_in(stdin)
+{
+    in = &console_in;
+    out = &console_out;
+    Machine::update_io();
+
+    sample_interval = 0;
+    live = nullptr;
+    stop_flag = false;
+    breaks = 0;
+    Machine::clear_counters();
+}
+
+void Machine::set_input(IOChannel *in)
+{
+    Machine::in = (in == nullptr) ? &console_in : in;
+    Machine::update_io();
+}
+
+void Machine::set_output(IOChannel *out)
+{
+    bool async = (async_out != nullptr);
+
+    Machine::set_async_output(false);
+    Machine::out->flush();
+    Machine::out = (out == nullptr) ? &console_out : out;
+    Machine::update_io();
+    Machine::set_async_output(async);
+}
+
+void Machine::set_async_output(bool flag)
+{
+    if (flag && async_out == nullptr){
+        async_out.reset(new AsyncChannel(out));
+        out = async_out.get();
+    }
+    else if (!flag && async_out != nullptr){
+        out = async_out->get_sink();
+        async_out.reset();          // flush and stop writer thread
+    }
+    Machine::update_io();
+}
+
+void Machine::update_io()
+{
+    inject.attach(in, out);
+    if (inject.pending()){
+        cpu.set_io(&inject, &inject);
+    }
+    else {
+        cpu.set_io(in, out);
+    }
+}
+
+CPUSTAT Machine::run(const RunLimit &limit)
+{
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    auto last = start;
+    auto next_sample = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(sample_interval));
+    UINT64 insts_end = (limit.insts == 0) ? ~0ULL : cpu.get_insts() + limit.insts;
+    UINT64 cycles_end = (limit.cycles == 0) ? ~0ULL : cpu.get_cycles() + limit.cycles;
+    CPUSTAT status;
+
+    cpu.run_mode(RUN);
+    cpu.pass_break();
+    while (1){
+        Machine::apply_events();
+
+        UINT64 slice_end = cpu.get_insts() + RUN_SLICE;
+        UINT64 event_end = events.empty() ? ~0ULL : events.front().cycle;
+        status = cpu.run(slice_end < insts_end ? slice_end : insts_end, event_end < cycles_end ? event_end : cycles_end);
+
+        auto now = clock::now();
+        count.run_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+        last = now;
+        if (live != nullptr){
+            live->publish(cpu, LIVE_RUNNING);
+        }
+        if (sample_interval > 0 && now >= next_sample){
+            std::cerr << "stats: " << Machine::stats_str() << std::endl;
+            next_sample = now + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(sample_interval));
+        }
+
+        if (status == SUCCESS){
+            if (stop_flag.load(std::memory_order_relaxed) && Machine::take_stop()){
+                status = STOPPED;
+                break;
+            }
+            if (cpu.get_insts() >= insts_end || cpu.get_cycles() >= cycles_end){
+                status = BUDGET;
+                break;
+            }
+            if (limit.timeout > 0){
+                std::chrono::duration<double> elapsed = now - start;
+                if (elapsed.count() >= limit.timeout){
+                    status = TIMEOUT;
+                    break;
+                }
+            }
+        }
+        else if (status != WAIT_INPUT || !Machine::wait_input()){
+            if (status == WAIT_INPUT && Machine::take_stop()){
+                status = STOPPED;           // GETC interrupted
+            }
+            break;
+        }
+        else {
+            cpu.pass_break();               // GETC again
+        }
+    }
+    if (status == STOPPED && limit.timeout > 0 && std::chrono::duration<double>(clock::now() - start).count() >= limit.timeout){
+        status = TIMEOUT;                   // stopped by a watchdog of the timeout (GETC blocked in a read)
+    }
+    Machine::flush();
+    Machine::account(status, std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - last).count());
+    if (live != nullptr){
+        live->publish(cpu, status);
+    }
+
+    return (status);
+}
+
+void Machine::set_live(LiveView *view)
+{
+    live = view;
+    if (live != nullptr){
+        memory.map(live->memory());
+        live->publish(cpu, SUCCESS);
+    }
+}
+
+// a breakpoint is ENTRY_BREAK of the entry map, setting it updates only the entries that may cover addr
+void Machine::set_break(WORD addr)
+{
+    if (entries == nullptr || ((*entries)[addr] & ENTRY_BREAK) == 0){
+        Machine::own_entries()[addr] |= ENTRY_BREAK;
+        breaks++;
+        Machine::update_near(addr);
+    }
+}
+
+void Machine::clear_break(WORD addr)
+{
+    if (entries == nullptr || ((*entries)[addr] & ENTRY_BREAK) == 0){
+        return;
+    }
+    Machine::own_entries()[addr] &= ~ENTRY_BREAK;
+    breaks--;
+    Machine::update_near(addr);
+    if (breaks == 0 && hle.empty() && aot == nullptr){
+        entries.reset();
+        Machine::use_entries();
+    }
+}
+
+void Machine::clear_breaks()
+{
+    if (breaks == 0){
+        return;
+    }
+    for (auto &entry : Machine::own_entries()){
+        entry &= ~ENTRY_BREAK;
+    }
+    breaks = 0;
+    Machine::update_entries();
+}
+
+// entry map not shared with another machine
+EntryMap &Machine::own_entries()
+{
+    if (entries == nullptr){
+        entries = std::make_shared<EntryMap>();
+        entries->fill(0);
+    }
+    else if (entries.use_count() > 1){
+        entries = std::make_shared<EntryMap>(*entries);
+    }
+    Machine::use_entries();
+
+    return (*entries);
+}
+
+// run() dispatches by the entry map, memory guards the trapped code by it
+void Machine::use_entries()
+{
+    const BYTE *map = (entries == nullptr) ? nullptr : entries->data();
+
+    cpu.set_entries(map);
+    memory.set_guard(map, ENTRY_CODE);
+}
+
+// every entry from the traps, blocks and breakpoints
+void Machine::update_entries()
+{
+    if (breaks == 0 && hle.empty() && aot == nullptr){
+        entries.reset();
+        Machine::use_entries();
+        return;
+    }
+    Machine::own_entries();
+    for (UINT32 addr = 0; addr <= 0xffff; addr++){
+        Machine::update_entry(addr);
+    }
+}
+
+// entries of traps, blocks and fused sequences which may cover addr
+void Machine::update_near(WORD addr)
+{
+    for (int i = 1; i <= ENTRY_REACH; i++){
+        Machine::update_entry((addr & BIT_PR_PAGE) | ((addr - i) & ~BIT_PR_PAGE));
+    }
+    for (auto &trap : hle.list()){
+        if ((WORD)(addr - trap.entry) < trap.length){
+            Machine::update_entry(trap.entry);
+        }
+    }
+    if (aot != nullptr){
+        for (UINT32 i = 0; i < 0x1000; i++){                   // blocks stay in the page
+            WORD from = (addr & BIT_PR_PAGE) | i;
+            if (aot->find(from) != nullptr){
+                Machine::update_entry(from);
+            }
+        }
+    }
+}
+
+// a trap or block is dispatched only without a breakpoint inside it
+void Machine::update_entry(WORD addr)
+{
+    BYTE entry = (*entries)[addr] & ENTRY_BREAK;
+    const HLETrap *trap = hle.find(addr);
+    const AOTBlock *block = (aot == nullptr) ? nullptr : aot->find(addr);
+
+    if (trap != nullptr && !Machine::break_in(addr, trap->length, false)){
+        entry |= ENTRY_HLE;
+    }
+    if (block != nullptr && !Machine::break_in(addr, (WORD)(block->last - addr) + 1, true)){
+        entry |= ENTRY_AOT;
+    }
+    if (Machine::break_in(addr, ENTRY_REACH + 1, true)){
+        entry |= ENTRY_STEP;
+    }
+    for (auto &code : hle.list()){
+        if ((WORD)(addr - code.entry) < code.length){
+            entry |= ENTRY_CODE;
+        }
+    }
+    (*entries)[addr] = entry;
+}
+
+// a breakpoint in the length bytes from addr, after addr (page: in the page of addr, as PC)
+bool Machine::break_in(WORD addr, int length, bool page)
+{
+    for (int i = 1; i < length && breaks > 0; i++){
+        WORD next = page ? (WORD)((addr & BIT_PR_PAGE) | ((addr + i) & ~BIT_PR_PAGE)) : (WORD)(addr + i);
+        if (((*entries)[next] & ENTRY_BREAK) != 0){
+            return (true);
+        }
+    }
+    return (false);
+}
+
+void Machine::schedule_sense(UINT64 cycle, BYTE bit, bool level)
+{
+    SenseEvent event = {cycle, bit, level};
+    auto pos = std::upper_bound(events.begin(), events.end(), event,
+                                [](const SenseEvent &a, const SenseEvent &b){return (a.cycle < b.cycle);});
+    events.insert(pos, event);
+}
+
+void Machine::apply_events()
+{
+    while (!events.empty() && events.front().cycle <= cpu.get_cycles()){
+        SenseEvent &event = events.front();
+        if (event.level){
+            cpu.setSR(cpu.getSR() | event.bit);
+        }
+        else {
+            cpu.setSR(cpu.getSR() & ~event.bit);
+        }
+        events.erase(events.begin());
+    }
+}
+
+void Machine::clear_counters()
+{
+    cpu.clear_counters();
+    count = Counters();
+}
+
+void Machine::account(CPUSTAT status, UINT64 ns)
+{
+    count.run_ns += ns;
+    if (status <= TIMEOUT){
+        count.stops[status]++;
+    }
+}
+
+std::string Machine::stats_str()
+{
+    static const char *stop_name[TIMEOUT + 1] = {
+        "success", "halt", "interrupt", "undefined", "noinput", "budget", "timeout"
+    };
+    std::stringstream out;
+    double run = count.run_ns / 1e9;
+    double input = (count.input_ns + cpu.get_input_ns()) / 1e9;
+    double exec = (run > input) ? run - input : 0;
+
+    out << std::fixed << std::setprecision(6);
+    out << "insts=" << cpu.get_insts();
+    out << " cycles=" << cpu.get_cycles();
+    out << " interrupts=" << cpu.get_interrupts();
+    out << " skipped=" << cpu.get_skipped();
+    out << " fused=" << cpu.get_fused();
+    out << " hle_hits=" << hle.hits();
+    out << " memo_hits=" << memo.hits();
+    out << " aot_hits=" << cpu.get_aot_hits();
+    out << " private_pages=" << memory.private_pages();
+    out << " run_time=" << run;
+    out << " exec_time=" << exec;
+    out << " input_time=" << input;
+    out << std::setprecision(3);
+    out << " mips=" << (exec > 0 ? cpu.get_insts() / exec / 1e6 : 0.0);
+    out << " mhz=" << (exec > 0 ? cpu.get_cycles() / exec / 1e6 : 0.0);
+    for (int i = HALT; i <= TIMEOUT; i++){
+        if (i != INTERRPT){
+            out << " " << stop_name[i] << "=" << count.stops[i];
+        }
+    }
+
+    return (out.str());
+}
+
+bool Machine::wait_input()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    out->flush();
+    bool result = inject.wait_input();
+
+    count.input_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    return (result);
+}
+
+void Machine::flush()
+{
+    out->flush();
+}
+
+bool Machine::load_hle(const std::string &filename, bool verify)
+{
+    bool result = hle.load(filename, memory);
+
+    hle.set_verify(verify);
+    cpu.set_hle(hle.empty() ? nullptr : &hle);
+    Machine::update_entries();
+
+    return (result);
+}
+
+void Machine::copy_config(Machine &from)
+{
+    cpu.set_fast_forward(from.cpu.get_fast_forward());
+    cpu.set_fusion(from.cpu.get_fusion());
+    hle = from.hle;
+    cpu.set_hle(hle.empty() ? nullptr : &hle);
+    memo.copy(from.memo);
+    cpu.set_memo(from.cpu.get_memo() == nullptr ? nullptr : &memo);
+    aot = from.aot;
+    cpu.set_aot(aot.get());
+    if (breaks == 0 && from.breaks == 0){
+        entries = from.entries;         // same traps and blocks
+        Machine::use_entries();
+    }
+    else {
+        Machine::update_entries();
+    }
+}
+
+void Machine::set_memo(bool flag)
+{
+    cpu.set_memo(flag ? &memo : nullptr);
+}
+
+bool Machine::load_memo(const std::string &filename)
+{
+    std::ifstream file(filename);
+
+    Machine::set_memo(true);
+    if (file.fail()){
+        return (true);          // created by save_memo()
+    }
+    file.close();
+
+    return (memo.load(filename));
+}
+
+bool Machine::save_memo(const std::string &filename)
+{
+    memo.abort();
+    return (memo.save(filename));
+}
+
+void Machine::set_opstats(bool flag)
+{
+    if (!flag){
+        opstats.reset();
+    }
+    else if (opstats == nullptr){
+        opstats.reset(new OpStats());
+    }
+    cpu.set_opstats(opstats.get());
+}
+
+bool Machine::attach_aot(const std::string &name)
+{
+    auto blocks = (aot == nullptr) ? std::make_shared<AOT>() : std::make_shared<AOT>(*aot);
+    bool result = blocks->attach(name);
+
+    if (!blocks->empty()){
+        aot = blocks;
+    }
+    cpu.set_aot(aot.get());
+    Machine::update_entries();
+
+    return (result);
+}
+
+bool Machine::load_basic(const std::string &filename, bool line_mode)
+{
+    std::ifstream file;
+    std::string line, text;
+    int lines = 0;
+
+    file.open(filename);
+    if (file.fail()){
+        std::cout << "File not found!(" << filename << ")" << std::endl;
+        return (false);
+    }
+    while (getline(file, line)){
+        if (!line.empty() && line.back() == '\r'){
+            line.pop_back();
+        }
+        lines++;
+
+        if (!line_mode){
+            text += line + "\n";
+            continue;
+        }
+
+        // run the line editor of NIBL until it asks for the next line
+        StringChannel line_in(line + "\n");
+        IOChannel discard;
+        CPUSTAT status = SUCCESS;
+
+        line_in.set_cooked(in->is_cooked());
+        cpu.set_io(&line_in, &discard);
+        cpu.run_mode(RUN);
+        for (UINT32 step = 0; status == SUCCESS && step < BASIC_LINE_STEPS; step++){
+            status = cpu.clock();
+        }
+        Machine::update_io();
+
+        if (status != WAIT_INPUT){
+            std::cout << filename << ":" << lines << ": line not accepted" << std::endl;
+            return (false);
+        }
+    }
+    file.close();
+
+    if (!line_mode){
+        inject.feed(text);      // consumed by GETC ahead of the console
+        Machine::update_io();
+    }
+
+    std::cout << filename << "(" << lines << " lines)" << std::endl;
+
+    return (true);
+}
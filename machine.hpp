@@ -0,0 +1,150 @@
+#ifndef MACHINE_HPP
+#define MACHINE_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <atomic>
+#include "common.h"
+#include "memory.hpp"
+#include "io.hpp"
+#include "cpu.hpp"
+#include "hle.hpp"
+#include "memo.hpp"
+#include "aot.hpp"
+#include "opstats.hpp"
+#include "live.hpp"
+
+// limits of Machine::run() (0: no limit)
+struct RunLimit {
+    UINT64 insts;       // instructions
+    UINT64 cycles;      // micro cycles
+    double timeout;     // wall-clock seconds
+};
+
+// runtime counters of Machine (CPU counts instructions, cycles and interrupts)
+struct Counters {
+    UINT64 run_ns;                  // host time in run loops
+    UINT64 input_ns;                // host time waiting for input outside GETC
+    UINT64 stops[TIMEOUT + 1];      // reasons of run loop stop, by CPUSTAT
+};
+
+// change of a sense input at a virtual time
+struct SenseEvent {
+    UINT64 cycle;       // micro cycles from reset of counters
+    BYTE bit;           // BIT_SR_SA or BIT_SR_SB
+    bool level;
+};
+
+// SC/MP system: memory, CPU and character I/O channels
+class Machine {
+public:
+    Machine();
+
+    Memory memory;
+    CPU cpu;
+    HLE hle;
+    Memo memo;
+    std::shared_ptr<const AOT> aot;        // shared by copy_config() (nullptr: none)
+    std::unique_ptr<OpStats> opstats;      // while set_opstats(true)
+
+    void set_input(IOChannel *in);
+    void set_output(IOChannel *out);
+    inline IOChannel &input(){return (*in);};
+    inline IOChannel &output(){return (*out);};
+    inline bool console_input(){return (in == &console_in);};
+
+    void set_async_output(bool flag);   // PUTC through writer thread
+
+    CPUSTAT run(const RunLimit &limit);
+
+    // run() returns STOPPED at the next slice or GETC (any thread, signal handler)
+    inline void request_stop(){stop_flag.store(true, std::memory_order_relaxed);};
+    inline bool take_stop(){return (stop_flag.exchange(false));};      // clears the request
+
+    // breakpoints: run() returns BREAK before the instruction at addr (first byte of it),
+    // it goes on at a breakpoint it starts at
+    void set_break(WORD addr);
+    void clear_break(WORD addr);
+    void clear_breaks();
+
+    // external sense input events, applied by run() at their cycle
+    void schedule_sense(UINT64 cycle, BYTE bit, bool level);
+    inline void clear_events(){events.clear();};
+    inline void copy_events(const Machine &from){events = from.events;};
+
+    // fast forward, fusion, native routines, memo cache and compiled blocks of from
+    void copy_config(Machine &from);
+
+    // performance counters
+    inline const Counters &counters(){return (count);};
+    void clear_counters();
+    void account(CPUSTAT status, UINT64 ns);       // a run loop stopped
+    std::string stats_str();
+    inline void set_sample_interval(double sec){sample_interval = sec;};
+
+    bool wait_input();
+    void flush();
+
+    // native routines from description file (verify: compare with the interpreter)
+    bool load_hle(const std::string &filename, bool verify = false);
+
+    // memoization of XPPC calls (cache file is optional)
+    void set_memo(bool flag);
+    bool load_memo(const std::string &filename);
+    bool save_memo(const std::string &filename);
+
+    // opcode and bigram statistics of executed instructions (counters are freed when turned off)
+    void set_opstats(bool flag);
+
+    // statically compiled blocks linked into the executable ("all": every image)
+    bool attach_aot(const std::string &name);
+
+    // memory in the region of view, registers published by run() (nullptr: none)
+    void set_live(LiveView *view);
+
+    // BASIC program text as console input (line_mode: enter now, line by line)
+    bool load_basic(const std::string &filename, bool line_mode = false);
+
+private:
+    IOChannel *in;
+    IOChannel *out;
+    InjectChannel inject;
+
+    void update_io();
+
+    std::vector<SenseEvent> events;     // sorted by cycle
+    void apply_events();
+
+    Counters count;
+    double sample_interval;     // seconds between stats on stderr (0: none)
+
+    // default console
+    FileChannel console_in;
+    StdoutChannel console_out;
+
+    std::unique_ptr<AsyncChannel> async_out;
+
+    LiveView *live;
+
+    std::atomic<bool> stop_flag;
+
+    // ENTRY_* of each address for CPU::run() (nullptr: no trap, block or breakpoint),
+    // shared by copy_config() until a breakpoint changes it
+    std::shared_ptr<EntryMap> entries;
+    UINT32 breaks;              // ENTRY_BREAK in entries
+    EntryMap &own_entries();    // private copy to change
+    void use_entries();         // entries changed or replaced
+    void update_entries();      // traps or blocks changed
+    void update_near(WORD addr);        // entries which may cover addr
+    void update_entry(WORD addr);
+    bool break_in(WORD addr, int length, bool page);
+};
+
+// instructions executed between checks of the wall clock
+const UINT64 RUN_SLICE = 64 * 1024;
+
+// instructions allowed for entering one line in line mode
+const UINT32 BASIC_LINE_STEPS = 1000 * 1000;
+
+#endif
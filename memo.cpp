@@ -0,0 +1,428 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include "common.h"
+#include "memory.hpp"
+#include "io.hpp"
+#include "cpu.hpp"
+#include "memo.hpp"
+
+// access of an address while recording
+const BYTE ACCESS_SEEN    = 0x01;
+const BYTE ACCESS_READ    = 0x02;   // first access was read
+const BYTE ACCESS_WRITTEN = 0x04;
+const BYTE ACCESS_CODE    = 0x08;   // fetched as instruction
+
+Memo::Memo(Memory &memory): memory(memory)
+{
+    cpu = nullptr;
+    recording = false;
+    replayed = 0;
+    access.fill(0);
+}
+
+Memo::~Memo()
+{
+    Memo::abort();
+}
+
+void Memo::clear()
+{
+    Memo::abort();
+    routines.clear();
+    replayed = 0;
+}
+
+void Memo::copy(const Memo &from)
+{
+    Memo::abort();
+    routines = from.routines;
+}
+
+size_t Memo::records()
+{
+    size_t n = 0;
+
+    for (auto &routine : routines){
+        n += routine.second.records.size();
+    }
+    return (n);
+}
+
+MemoRegs Memo::get_regs(CPU &cpu)
+{
+    MemoRegs regs = {cpu.getAC(), cpu.getER(), cpu.getSR(), {cpu.getPC(), cpu.getP1(), cpu.getP2(), cpu.getP3()}};
+
+    return (regs);
+}
+
+void Memo::set_regs(CPU &cpu, const MemoRegs &regs)
+{
+    cpu.setAC(regs.AC);
+    cpu.setER(regs.ER);
+    cpu.setSR(regs.SR);
+    cpu.setPC(regs.PR[0]);
+    cpu.setP1(regs.PR[1]);
+    cpu.setP2(regs.PR[2]);
+    cpu.setP3(regs.PR[3]);
+}
+
+UINT64 Memo::key(const MemoRegs &regs, const std::vector<BYTE> &probes)
+{
+    UINT64 h = ((UINT64)regs.AC << 56) ^ ((UINT64)regs.ER << 48) ^ ((UINT64)regs.SR << 40) ^
+               ((UINT64)regs.PR[1] << 32) ^ ((UINT64)regs.PR[0] << 24) ^ ((UINT64)regs.PR[2] << 16) ^ (UINT64)regs.PR[3];
+
+    for (BYTE data : probes){
+        h = (h ^ data) * 1099511628211ULL;
+    }
+    return (h);
+}
+
+bool Memo::same(const MemoRegs &a, const MemoRegs &b)
+{
+    return (a.AC == b.AC && a.ER == b.ER && a.SR == b.SR &&
+            a.PR[0] == b.PR[0] && a.PR[1] == b.PR[1] && a.PR[2] == b.PR[2] && a.PR[3] == b.PR[3]);
+}
+
+//
+// XPPC is a call of the code at the new PC + 1 until an XPPC returns to the site,
+// or the return of a call (recorded the same way until the next call comes back).
+//
+bool Memo::xppc(CPU &cpu, WORD site, bool interrupt, UINT64 insts_left, UINT64 cycles_left)
+{
+    if (recording){
+        if (interrupt){
+            Memo::abort();
+            return (false);
+        }
+        if (cpu.getPC() != Memo::site){
+            return (false);         // nested call
+        }
+        Memo::finish();
+    }
+    if (interrupt || ((cpu.getSR() & BIT_SR_IE) != 0 && (cpu.getSR() & BIT_SR_SA) != 0)){
+        return (false);
+    }
+
+    WORD pc = cpu.getPC();
+    WORD entry = (pc & BIT_PR_PAGE) | ((pc + 1) & ~BIT_PR_PAGE);
+    MemoRoutine &routine = routines[entry];
+    if (routine.disabled){
+        return (false);
+    }
+
+    MemoRegs regs = Memo::get_regs(cpu);
+    std::vector<BYTE> probes;
+    for (WORD addr : routine.probes){
+        probes.push_back(memory.read(addr));
+    }
+    UINT64 k = Memo::key(regs, probes);
+    auto range = routine.records.equal_range(k);
+    size_t same = 0;
+    for (auto it = range.first; it != range.second; ++it){
+        MemoRecord &rec = it->second;
+        same++;
+        if (!Memo::same(rec.in, regs) || rec.insts > insts_left || rec.cycles > cycles_left){
+            continue;
+        }
+        bool match = true;
+        for (auto &read : rec.reads){
+            if (memory.read(read.first) != read.second || cpu.is_entry(read.first, ENTRY_BREAK)){      // or a breakpoint in the call
+                match = false;
+                break;
+            }
+        }
+        if (match){
+            for (auto &write : rec.writes){
+                memory.write(write.first, write.second);
+            }
+            Memo::set_regs(cpu, rec.out);
+            cpu.advance(rec.insts, rec.cycles);
+            replayed++;
+            return (true);
+        }
+    }
+
+    if (same < MEMO_MAX_SAME && routine.records.size() < MEMO_MAX_RECORDS){
+        Memo::start(cpu, entry, site, k);
+    }
+    return (false);
+}
+
+void Memo::start(CPU &cpu, WORD entry, WORD site, UINT64 key)
+{
+    Memo::cpu = &cpu;
+    Memo::entry = entry;
+    Memo::site = site;
+    record_key = key;
+    record.in = Memo::get_regs(cpu);
+    record.reads.clear();
+    record.writes.clear();
+    start_insts = cpu.get_insts();
+    start_cycles = cpu.get_cycles();
+    expect_opcode = true;
+    recording = true;
+    memory.set_watch(this);
+}
+
+void Memo::finish()
+{
+    memory.set_watch(nullptr);
+    for (WORD addr : touched){
+        if ((access[addr] & ACCESS_WRITTEN) != 0){
+            record.writes.push_back(std::make_pair(addr, memory.read(addr)));
+        }
+    }
+    record.out = Memo::get_regs(*cpu);
+    record.insts = cpu->get_insts() - start_insts;
+    record.cycles = cpu->get_cycles() - start_cycles;
+    if (record.insts < MEMO_MIN_INSTS){
+        Memo::reject();
+        return;
+    }
+
+    // data differs between calls more often than code
+    std::stable_partition(record.reads.begin(), record.reads.end(),
+                          [this](const std::pair<WORD, BYTE> &read){return ((access[read.first] & ACCESS_CODE) == 0);});
+
+    // the first call decides the data bytes added to the key
+    MemoRoutine &routine = routines[entry];
+    if (!routine.probed){
+        std::vector<BYTE> probes;
+        for (auto &read : record.reads){
+            if (routine.probes.size() >= MEMO_PROBES || (access[read.first] & ACCESS_CODE) != 0){
+                break;
+            }
+            routine.probes.push_back(read.first);
+            probes.push_back(read.second);
+        }
+        routine.probed = true;
+        record_key = Memo::key(record.in, probes);
+    }
+    routine.records.insert(std::make_pair(record_key, record));
+
+    Memo::abort();
+}
+
+void Memo::abort()
+{
+    if (!recording){
+        return;
+    }
+    memory.set_watch(nullptr);
+    for (WORD addr : touched){
+        access[addr] = 0;
+    }
+    touched.clear();
+    recording = false;
+}
+
+void Memo::reject()
+{
+    routines[entry].disabled = true;
+    Memo::abort();
+}
+
+void Memo::on_read(WORD addr, BYTE data)
+{
+    if ((access[addr] & ACCESS_SEEN) == 0){
+        access[addr] = ACCESS_SEEN | ACCESS_READ;
+        touched.push_back(addr);
+        record.reads.push_back(std::make_pair(addr, data));
+        if (record.reads.size() > MEMO_MAX_READS){
+            Memo::reject();
+        }
+    }
+}
+
+void Memo::on_fetch(WORD addr, BYTE data)
+{
+    if ((access[addr] & ACCESS_WRITTEN) != 0){      // executes code it wrote
+        Memo::reject();
+        return;
+    }
+    Memo::on_read(addr, data);
+    if (!recording){
+        return;
+    }
+    access[addr] |= ACCESS_CODE;
+
+    if (expect_opcode){
+        switch (data){
+        case OPE_HALT:
+        case OPE_IEN:
+        case OPE_SIO:
+        case OPE_PUTC:
+        case OPE_GETC:
+            Memo::reject();
+            return;
+        }
+        expect_opcode = ((data & BIT_SIGN_BYTE) == 0);      // double-byte instruction
+    }
+    else {
+        expect_opcode = true;
+    }
+    if (cpu->get_insts() - start_insts > MEMO_MAX_INSTS){
+        Memo::reject();
+    }
+}
+
+void Memo::on_write(WORD addr, BYTE data)
+{
+    BYTE &flag = access[addr];
+
+    if ((flag & ACCESS_CODE) != 0){                 // self-modifying
+        Memo::reject();
+        return;
+    }
+    if ((flag & ACCESS_SEEN) == 0){
+        touched.push_back(addr);
+    }
+    if ((flag & ACCESS_WRITTEN) == 0){
+        flag |= ACCESS_SEEN | ACCESS_WRITTEN;
+        if (touched.size() > MEMO_MAX_READS + MEMO_MAX_WRITES){
+            Memo::reject();
+        }
+    }
+}
+
+//
+// cache file: one call per line (hex)
+//
+//   P entry n addr ...                  probes of a routine
+//   entry key  AC ER SR PC P1 P2 P3 (in)  AC ER SR PC P1 P2 P3 (out)  insts cycles
+//          R n addr:data ...  W n addr:data ...
+//
+bool Memo::save(const std::string &filename)
+{
+    std::ofstream file;
+
+    file.open(filename);
+    if (file.fail()){
+        std::cout << "OPEN ERROR!!" << filename << std::endl;
+        return (false);
+    }
+    file << std::hex;
+    file << "# scmp2 memo cache" << std::endl;
+    for (auto &routine : routines){
+        if (routine.second.disabled || !routine.second.probed){
+            continue;
+        }
+        file << "P " << routine.first << " " << routine.second.probes.size();
+        for (WORD addr : routine.second.probes){
+            file << " " << addr;
+        }
+        file << std::endl;
+        for (auto &it : routine.second.records){
+            const MemoRecord &rec = it.second;
+            file << routine.first << " " << it.first;
+            for (const MemoRegs *regs : {&rec.in, &rec.out}){
+                file << " " << (int)regs->AC << " " << (int)regs->ER << " " << (int)regs->SR;
+                for (int i = 0; i < 4; i++){
+                    file << " " << regs->PR[i];
+                }
+            }
+            file << " " << rec.insts << " " << rec.cycles;
+            file << " R " << rec.reads.size();
+            for (auto &read : rec.reads){
+                file << " " << read.first << ":" << (int)read.second;
+            }
+            file << " W " << rec.writes.size();
+            for (auto &write : rec.writes){
+                file << " " << write.first << ":" << (int)write.second;
+            }
+            file << std::endl;
+        }
+    }
+    file.close();
+
+    return (true);
+}
+
+bool Memo::load(const std::string &filename)
+{
+    std::ifstream file;
+    std::string line;
+    int lines = 0;
+    size_t loaded = 0;
+
+    file.open(filename);
+    if (file.fail()){
+        std::cout << "File not found!(" << filename << ")" << std::endl;
+        return (false);
+    }
+    while (getline(file, line)){
+        lines++;
+        if (line.empty() || line[0] == '#'){
+            continue;
+        }
+
+        std::stringstream ss(line);
+        MemoRecord rec;
+        unsigned int entry, value[14];
+        UINT64 key;
+        std::string tag;
+        size_t n;
+        char colon;
+        bool ok = true;
+
+        if (line[0] == 'P'){
+            ss >> tag >> std::hex >> entry >> n;
+            MemoRoutine &routine = routines[entry];
+            routine.probes.clear();
+            for (size_t i = 0; i < n && !ss.fail(); i++){
+                unsigned int addr;
+                ss >> addr;
+                routine.probes.push_back(addr);
+            }
+            routine.probed = true;
+            if (ss.fail() || n > MEMO_PROBES){
+                std::cout << filename << ":" << lines << ": syntax error" << std::endl;
+                return (false);
+            }
+            continue;
+        }
+
+        ss >> std::hex >> entry >> key;
+        for (auto &v : value){
+            ss >> v;
+        }
+        ss >> rec.insts >> rec.cycles;
+        for (int i = 0; i < 2; i++){
+            MemoRegs &regs = (i == 0) ? rec.in : rec.out;
+            regs.AC = value[i * 7 + 0];
+            regs.ER = value[i * 7 + 1];
+            regs.SR = value[i * 7 + 2];
+            for (int j = 0; j < 4; j++){
+                regs.PR[j] = value[i * 7 + 3 + j];
+            }
+        }
+        for (auto *set : {&rec.reads, &rec.writes}){
+            ss >> tag >> n;
+            ok = ok && !ss.fail() && tag == ((set == &rec.reads) ? "R" : "W");
+            for (size_t i = 0; ok && i < n; i++){
+                unsigned int addr, data;
+                ss >> addr >> colon >> data;
+                ok = !ss.fail() && colon == ':';
+                set->push_back(std::make_pair((WORD)addr, (BYTE)data));
+            }
+        }
+        if (!ok || ss.fail()){
+            std::cout << filename << ":" << lines << ": syntax error" << std::endl;
+            return (false);
+        }
+        if (!routines[entry].probed){
+            std::cout << filename << ":" << lines << ": no probes" << std::endl;
+            return (false);
+        }
+        routines[entry].records.insert(std::make_pair(key, rec));
+        loaded++;
+    }
+    file.close();
+
+    std::cout << filename << "(" << loaded << " calls)" << std::endl;
+
+    return (true);
+}
@@ -0,0 +1,97 @@
+#ifndef MEMO_HPP
+#define MEMO_HPP
+
+#include <string>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <utility>
+#include "common.h"
+#include "memory.hpp"
+#include "cpu.hpp"
+
+// limits of a recorded call
+const UINT64 MEMO_MAX_INSTS   = 64 * 1024;
+const size_t MEMO_MAX_READS   = 512;
+const size_t MEMO_MAX_WRITES  = 256;
+const size_t MEMO_MAX_RECORDS = 64 * 1024;     // per routine
+const size_t MEMO_MAX_SAME    = 256;           // per routine and registers
+const UINT64 MEMO_MIN_INSTS   = 16;            // shorter calls are not worth replaying
+const size_t MEMO_PROBES      = 4;             // data bytes in the key
+
+// registers at the call (PC = entry - 1) and at the return (PC = call site)
+struct MemoRegs {
+    BYTE AC;
+    BYTE ER;
+    BYTE SR;
+    WORD PR[4];
+};
+
+// effect of one call
+struct MemoRecord {
+    MemoRegs in;
+    MemoRegs out;
+    std::vector<std::pair<WORD, BYTE> > reads;     // first access was read (data first, then code)
+    std::vector<std::pair<WORD, BYTE> > writes;    // final values
+    UINT64 insts;
+    UINT64 cycles;
+};
+
+struct MemoRoutine {
+    bool disabled;          // I/O, HALT, IEN, self-modifying code or too short
+    bool probed;            // probes are fixed
+    std::vector<WORD> probes;                               // first data read by the first call
+    std::unordered_multimap<UINT64, MemoRecord> records;   // by hash of MemoRegs in and probes
+};
+
+// memoization of XPPC calls: record the read set, write set and registers, replay on a match
+class Memo : public MemoryWatch {
+public:
+    Memo(Memory &memory);
+    ~Memo();
+
+    // after an XPPC in CPU::run(); true: a recorded call was replayed
+    bool xppc(CPU &cpu, WORD site, bool interrupt, UINT64 insts_left, UINT64 cycles_left);
+    void abort();           // stop recording
+    void clear();
+    void copy(const Memo &from);        // recorded routines
+
+    bool load(const std::string &filename);     // cache file
+    bool save(const std::string &filename);
+
+    inline UINT64 hits(){return (replayed);};
+    size_t records();
+
+    void on_read(WORD addr, BYTE data);
+    void on_fetch(WORD addr, BYTE data);
+    void on_write(WORD addr, BYTE data);
+
+private:
+    Memory &memory;
+    std::unordered_map<WORD, MemoRoutine> routines;     // by entry address
+    UINT64 replayed;
+
+    // recording
+    CPU *cpu;
+    bool recording;
+    WORD entry;
+    WORD site;
+    UINT64 record_key;
+    MemoRecord record;
+    UINT64 start_insts;
+    UINT64 start_cycles;
+    bool expect_opcode;                         // next fetch is the first byte of an instruction
+    std::array<BYTE, 64 * 1024> access;         // ACCESS_* of each address
+    std::vector<WORD> touched;
+
+    void start(CPU &cpu, WORD entry, WORD site, UINT64 key);
+    void finish();
+    void reject();          // the routine is not memoizable
+
+    static MemoRegs get_regs(CPU &cpu);
+    static void set_regs(CPU &cpu, const MemoRegs &regs);
+    static UINT64 key(const MemoRegs &regs, const std::vector<BYTE> &probes);
+    static bool same(const MemoRegs &a, const MemoRegs &b);
+};
+
+#endif
@@ -1,232 +1,527 @@
-#include <iostream>     // for std::cout
-#include <iomanip>      // for std::setw, std::setfill>
-#include <fstream>
-#include <string>
-#include "common.h"
-#include "util.hpp"
-#include "memory.hpp"
-
-Memory::Memory()
-{
-    Memory::clear();
-}
-
-void Memory::clear()
-{
-    memory.fill(0);
-}
-
-void Memory::clear(BYTE data)
-{
-    memory.fill(data);
-}
-
-BYTE Memory::read(WORD addr)
-{
-    return (memory.at(addr));
-}
-
-void Memory::write(WORD addr, BYTE data)
-{
-    memory.at(addr) = data;
-}
-
-void Memory::dump(WORD start_addr, WORD end_addr)
-{
-    std::string char_str;
-    BYTE data;
-
-    std::cout << "addr +0 +1 +2 +3 +4 +5 +6 +7 +8 +9 +a +b +c +d +e +f" << std::endl;
-    for (int addr = start_addr & 0xfff0; addr <= end_addr; addr++){
-        if ((addr & 0x0f) == 0){
-            std::cout << Util::hex2str((WORD)addr);
-        }
-        if (addr < start_addr){
-            std::cout << "   ";
-            char_str += " ";
-        }
-        else {
-            data = Memory::read(addr);
-            std::cout << " " << Util::hex2str(data);
-            if (' ' <= data && data <= '}'){
-                char_str += data;
-            }
-            else {
-                char_str += ".";
-            }
-        }
-        if ((addr & 0x0f) == 0xf || addr == end_addr){
-            std::cout << "  " << char_str << std::endl;
-            char_str = "";
-        }
-    }
-}
-
-bool Memory::load(std::string filename)
-{
-    std::ifstream file;
-    std::string line;
-
-    file.open(filename);
-    if (file.fail()){
-        std::cout << "File not found!(" << filename << ")" << std::endl;
-        return (false);
-    }
-
-    int start_addr = 0x0ffff;
-    int end_addr = 0;
-    while (getline(file, line)) {  // 1行ずつ読み込む
-        if (file.fail()){
-            std::cout << "Read ERROR!!" << filename << std::endl;
-            file.close();
-            return (false);
-        }
-        if (!Memory::check_csum(line)){
-            std::cout << "Check sum ERROR!!" << std::endl;
-            file.close();
-            return (false);           
-        }
-
-        std::string record = line.substr(0, 2);
-        int len = stoul(line.substr(2, 2), nullptr, 16);
-        int addr = stoul(line.substr(4, 4), nullptr, 16);
-        if (record == "S0"){
-            // nothing to do
-        }
-        else if (record == "S1"){
-            for (int i = 0; i < len - 3; i++){
-                int data = stoul(line.substr(i * 2 + 8, 2), nullptr, 16);
-                Memory::write(i + addr, (BYTE)data);
-                if (start_addr > i + addr){
-                    start_addr = i + addr;
-                }
-                if (end_addr < i + addr){
-                    end_addr = i + addr;
-                }
-            }
-        }
-        else if (record == "S5"){
-        
-        }
-        else if (record == "S9"){
-            if (line != "S9030000FC"){
-                std::cout << "FORMAT ERROR(S9)!!" << std::endl;
-                file.close();
-                return (false);
-            }
-        }
-        else {
-            std::cout << "FORMAT ERROR(unknown record)!!" << std::endl;
-            file.close();
-            return (false);
-        }
-    }
-
-    file.close();
-
-    std::cout << filename << "(";
-    std::cout << Util::hex2str((WORD)start_addr);
-    std::cout << ":";
-    std::cout << Util::hex2str((WORD)end_addr);
-    std::cout << ")" << std::endl;
-
-    return (true);
-}
-
-bool Memory::check_csum(const std::string &line)
-{
-    int csum;
-
-    csum = 0;
-    for (int i = 0; i < stoi(line.substr(2, 2), nullptr, 16) + 1; i++){
-        csum += stoul(line.substr(i * 2 + 2, 2), nullptr, 16);
-        csum %= 256;
-    }
-    if (csum % 256 != 255){
-        return (false);
-    }
-    return (true);
-}
-
-bool Memory::save(std::string filename, WORD start_addr, WORD end_addr)
-{
-    std::ofstream file;
-    int csum;
-    int count;
-
-    file.open(filename);
-    if (file.fail()){
-        std::cout << "OPEN ERROR!!" << filename << std::endl;
-        return (false);
-    }
-
-    // S0フィールド
-    file << "S0";
-    file << Util::hex2str_upper((BYTE)(filename.length() + 3));
-    file << "0000";
-
-    csum = filename.length() + 3;
-    for (unsigned int i = 0; i < filename.length(); i++){
-        file << Util::hex2str_upper((BYTE)filename.at(i));
-        csum += (int)filename.at(i);
-    }
-    file << Util::hex2str_upper((BYTE)((csum ^ 0x0ff) & 0x0ff));
-    file << std::endl;
-
-    // S1フィールド
-    count = 0;
-    for (int addr = start_addr; addr <= end_addr; addr++){
-        if ((addr == start_addr) || (addr % 16) == 0){
-            count++;
-            csum = 0;
-            file << "S1";
-            int bytes = 16;
-            if (addr == start_addr){
-                bytes -= start_addr;
-            }
-            if ((addr & 0xfff0) + 15 > end_addr){
-                bytes -= (15 - (end_addr % 16));
-            }
-            bytes += 3;
-            file << Util::hex2str_upper((BYTE)bytes);
-            file << Util::hex2str_upper((WORD)addr);
-
-            csum = bytes + (addr / 256) + (addr % 256);
-        }
-
-        int data = (int)Memory::read(addr);
-        file << Util::hex2str_upper((BYTE)data);
-        csum += data;
-
-        if ((addr == end_addr) || (addr % 16) == 15){
-            file << Util::hex2str_upper((BYTE)((csum ^ 0x0ff) & 0x0ff));
-            file << std::endl;
-        }
-    }
-
-    // S5フィールド
-    file << "S503";
-    file << Util::hex2str_upper((WORD)count);
-    csum = 3 + (count / 256) + (count % 256);
-    file << Util::hex2str_upper((BYTE)((csum ^ 0x0ff) & 0x0ff));
-    file << std::endl;
-
-    // S9フィールド
-    file << "S9030000FC" << std::endl;
-
-    if (file.fail()){
-        std::cout << "Write ERROR!!" << std::endl;
-        return (false);
-    }
-
-    file.close();
-
-    std::cout << filename << "(";
-    std::cout << Util::hex2str(start_addr);
-    std::cout << ":";
-    std::cout << Util::hex2str(end_addr);
-    std::cout << ")" << std::endl;
-
-    return (true);
-}
-
+#include <iostream>     // for std::cout
+#include <iomanip>      // for std::setw, std::setfill>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstring>
+#include "common.h"
+#include "util.hpp"
+#include "memory.hpp"
+
+//
+// pages shared by every instance in the process
+//
+static std::shared_ptr<MemoryPage> zero_page()
+{
+    static std::shared_ptr<MemoryPage> zero = std::make_shared<MemoryPage>(MemoryPage{});
+
+    return (zero);
+}
+
+// loaded pages by content hash (the page lives as long as an instance uses it)
+static std::mutex shared_mutex;
+static std::unordered_multimap<UINT64, std::weak_ptr<MemoryPage>> shared_pages;
+
+// FNV-1a
+static UINT64 page_hash(const MemoryPage &data)
+{
+    UINT64 hash = 0xcbf29ce484222325ULL;
+
+    for (auto d : data){
+        hash = (hash ^ d) * 0x100000001b3ULL;
+    }
+    return (hash);
+}
+
+// generations of every instance (0: none)
+static std::atomic<UINT64> next_generation(1);
+
+Memory::Memory()
+{
+    watch = nullptr;
+    view = nullptr;
+    guard = nullptr;
+    guard_flags = 0;
+    Memory::clear();
+}
+
+Memory::Memory(const Memory &other)
+{
+    view = nullptr;
+    guard = nullptr;
+    guard_flags = 0;
+    *this = other;
+}
+
+void Memory::renew()
+{
+    gen = next_generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+Memory &Memory::operator=(const Memory &other)
+{
+    if (this == &other){
+        return (*this);
+    }
+    Memory::renew();
+    if (view != nullptr){
+        for (int n = 0; n < MEMORY_PAGES; n++){
+            memcpy(page[n], other.page[n], MEMORY_PAGE_SIZE);
+        }
+        watch = other.watch;
+        return (*this);
+    }
+    for (int n = 0; n < MEMORY_PAGES; n++){
+        pages[n] = other.owned[n] ? std::make_shared<MemoryPage>(*other.pages[n]): other.pages[n];
+        page[n] = pages[n]->data();
+        owned[n] = other.owned[n];
+    }
+    watch = other.watch;
+    return (*this);
+}
+
+// pages written since the last fork() (private ones) are the only pages replaced
+void Memory::fork(const Memory &base)
+{
+    Memory::renew();
+    for (int n = 0; n < MEMORY_PAGES; n++){
+        if (view != nullptr){
+            memcpy(page[n], base.page[n], MEMORY_PAGE_SIZE);
+        }
+        else if (base.view != nullptr){
+            // pages in a region are written and unmapped by its owner: copied, not shared
+            pages[n] = std::make_shared<MemoryPage>(*base.pages[n]);
+            page[n] = pages[n]->data();
+            owned[n] = true;
+        }
+        else if (owned[n] || pages[n] != base.pages[n]){
+            pages[n] = base.pages[n];
+            page[n] = pages[n]->data();
+            owned[n] = false;
+        }
+    }
+}
+
+// run: address (2 bytes), length (2 bytes), data; end: length 0
+// Runs are searched only in pages not shared with base and never cross a page.
+void Memory::save_diff(std::ostream &file, const Memory &base)
+{
+    for (int n = 0; n < MEMORY_PAGES; n++){
+        if (pages[n] == base.pages[n]){
+            continue;
+        }
+        const BYTE *p = page[n];
+        const BYTE *b = base.page[n];
+        int i = 0;
+        while (i < MEMORY_PAGE_SIZE){
+            if (p[i] == b[i]){
+                i++;
+                continue;
+            }
+            // gaps shorter than a run header are taken into the run
+            int start = i, end = i;
+            while (i < MEMORY_PAGE_SIZE && i - end <= 4){
+                if (p[i] != b[i]){
+                    end = i + 1;
+                }
+                i++;
+            }
+            WORD addr = (n << MEMORY_PAGE_SHIFT) | start;
+            WORD length = end - start;
+            file.put(addr >> 8);
+            file.put(addr & 0xff);
+            file.put(length >> 8);
+            file.put(length & 0xff);
+            file.write((const char *)p + start, length);
+            i = end;
+        }
+    }
+    for (int i = 0; i < 4; i++){
+        file.put(0);
+    }
+}
+
+bool Memory::load_diff(std::istream &file, const Memory &base)
+{
+    Memory::fork(base);
+    while (1){
+        BYTE header[4];
+        if (!file.read((char *)header, 4)){
+            return (false);
+        }
+        WORD addr = (header[0] << 8) | header[1];
+        WORD length = (header[2] << 8) | header[3];
+        if (length == 0){
+            return (true);
+        }
+        int n = addr >> MEMORY_PAGE_SHIFT;
+        int offset = addr & (MEMORY_PAGE_SIZE - 1);
+        if (offset + length > MEMORY_PAGE_SIZE){
+            return (false);
+        }
+        if (!owned[n]){
+            Memory::own(n);
+        }
+        if (!file.read((char *)page[n] + offset, length)){
+            return (false);
+        }
+    }
+}
+
+void Memory::clear()
+{
+    Memory::renew();
+    if (view != nullptr){
+        memset(view, 0, MEMORY_PAGES * MEMORY_PAGE_SIZE);
+        return;
+    }
+    for (int n = 0; n < MEMORY_PAGES; n++){
+        pages[n] = zero_page();
+        page[n] = pages[n]->data();
+        owned[n] = false;
+    }
+}
+
+void Memory::clear(BYTE data)
+{
+    Memory::renew();
+    if (view != nullptr){
+        memset(view, data, MEMORY_PAGES * MEMORY_PAGE_SIZE);
+        return;
+    }
+    if (data == 0){
+        Memory::clear();
+        return;
+    }
+    for (int n = 0; n < MEMORY_PAGES; n++){
+        pages[n] = std::make_shared<MemoryPage>();
+        pages[n]->fill(data);
+        page[n] = pages[n]->data();
+        owned[n] = true;
+    }
+}
+
+// private pages (the rest is shared with other instances)
+int Memory::private_pages()
+{
+    int count = 0;
+
+    for (int n = 0; n < MEMORY_PAGES; n++){
+        if (owned[n]){
+            count++;
+        }
+    }
+    return (count);
+}
+
+// a page is never freed through the region
+void Memory::map(BYTE *region)
+{
+    Memory::renew();
+    for (int n = 0; n < MEMORY_PAGES; n++){
+        BYTE *p = region + n * MEMORY_PAGE_SIZE;
+        memcpy(p, page[n], MEMORY_PAGE_SIZE);
+        pages[n] = std::shared_ptr<MemoryPage>(reinterpret_cast<MemoryPage *>(p), [](MemoryPage *){});
+        page[n] = p;
+        owned[n] = true;
+    }
+    view = region;
+}
+
+// first write to a shared page
+void Memory::own(int n)
+{
+    pages[n] = std::make_shared<MemoryPage>(*pages[n]);
+    page[n] = pages[n]->data();
+    owned[n] = true;
+}
+
+// share a loaded page with the instances that loaded the same content
+void Memory::share(int n)
+{
+    if (view != nullptr){
+        return;
+    }
+    if (*pages[n] == *zero_page()){
+        pages[n] = zero_page();
+    }
+    else {
+        UINT64 hash = page_hash(*pages[n]);
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        std::shared_ptr<MemoryPage> found;
+
+        auto range = shared_pages.equal_range(hash);
+        for (auto it = range.first; it != range.second; ){
+            std::shared_ptr<MemoryPage> p = it->second.lock();
+            if (p == nullptr){
+                it = shared_pages.erase(it);        // no longer used
+                continue;
+            }
+            if (*p == *pages[n]){
+                found = p;
+                break;
+            }
+            it++;
+        }
+        if (found != nullptr){
+            pages[n] = found;
+        }
+        else if (owned[n]){
+            shared_pages.emplace(hash, pages[n]);
+        }
+        else {
+            return;                 // already shared
+        }
+    }
+    page[n] = pages[n]->data();
+    owned[n] = false;
+}
+
+BYTE Memory::read(WORD addr)
+{
+    BYTE data = page[addr >> MEMORY_PAGE_SHIFT][addr & (MEMORY_PAGE_SIZE - 1)];
+
+    if (watch != nullptr){
+        watch->on_read(addr, data);
+    }
+    return (data);
+}
+
+BYTE Memory::fetch(WORD addr)
+{
+    BYTE data = page[addr >> MEMORY_PAGE_SHIFT][addr & (MEMORY_PAGE_SIZE - 1)];
+
+    if (watch != nullptr){
+        watch->on_fetch(addr, data);
+    }
+    return (data);
+}
+
+void Memory::write(WORD addr, BYTE data)
+{
+    if (watch != nullptr){
+        watch->on_write(addr, data);
+    }
+    if (guard != nullptr && (guard[addr] & guard_flags) != 0){
+        Memory::renew();
+    }
+    if (!owned[addr >> MEMORY_PAGE_SHIFT]){
+        Memory::own(addr >> MEMORY_PAGE_SHIFT);
+    }
+    page[addr >> MEMORY_PAGE_SHIFT][addr & (MEMORY_PAGE_SIZE - 1)] = data;
+}
+
+void Memory::dump(WORD start_addr, WORD end_addr)
+{
+    std::string char_str;
+    BYTE data;
+
+    std::cout << "addr +0 +1 +2 +3 +4 +5 +6 +7 +8 +9 +a +b +c +d +e +f" << std::endl;
+    for (int addr = start_addr & 0xfff0; addr <= end_addr; addr++){
+        if ((addr & 0x0f) == 0){
+            std::cout << Util::hex2str((WORD)addr);
+        }
+        if (addr < start_addr){
+            std::cout << "   ";
+            char_str += " ";
+        }
+        else {
+            data = Memory::read(addr);
+            std::cout << " " << Util::hex2str(data);
+            if (' ' <= data && data <= '}'){
+                char_str += data;
+            }
+            else {
+                char_str += ".";
+            }
+        }
+        if ((addr & 0x0f) == 0xf || addr == end_addr){
+            std::cout << "  " << char_str << std::endl;
+            char_str = "";
+        }
+    }
+}
+
+bool Memory::load(std::string filename)
+{
+    std::ifstream file;
+
+    file.open(filename);
+    if (file.fail()){
+        std::cout << "File not found!(" << filename << ")" << std::endl;
+        return (false);
+    }
+    bool result = Memory::load(file, filename);
+    file.close();
+
+    return (result);
+}
+
+bool Memory::load(std::istream &file, const std::string &filename, bool verbose)
+{
+    std::ostream nowhere(nullptr);
+    std::ostream &out = verbose ? std::cout : nowhere;
+    std::string line;
+
+    int start_addr = 0x0ffff;
+    int end_addr = 0;
+    bool loaded[MEMORY_PAGES] = {};
+    while (getline(file, line)) {  // 1行ずつ読み込む
+        if (file.fail()){
+            out << "Read ERROR!!" << filename << std::endl;
+            return (false);
+        }
+        if (!Memory::check_csum(line)){
+            out << "Check sum ERROR!!" << std::endl;
+            return (false);           
+        }
+
+        std::string record = line.substr(0, 2);
+        int len = stoul(line.substr(2, 2), nullptr, 16);
+        int addr = stoul(line.substr(4, 4), nullptr, 16);
+        if (record == "S0"){
+            // nothing to do
+        }
+        else if (record == "S1"){
+            for (int i = 0; i < len - 3; i++){
+                int data = stoul(line.substr(i * 2 + 8, 2), nullptr, 16);
+                Memory::write(i + addr, (BYTE)data);
+                loaded[(WORD)(i + addr) >> MEMORY_PAGE_SHIFT] = true;
+                if (start_addr > i + addr){
+                    start_addr = i + addr;
+                }
+                if (end_addr < i + addr){
+                    end_addr = i + addr;
+                }
+            }
+        }
+        else if (record == "S5"){
+        
+        }
+        else if (record == "S9"){
+            if (line != "S9030000FC"){
+                out << "FORMAT ERROR(S9)!!" << std::endl;
+                return (false);
+            }
+        }
+        else {
+            out << "FORMAT ERROR(unknown record)!!" << std::endl;
+            return (false);
+        }
+    }
+
+    // image pages are shared until written
+    for (int n = 0; n < MEMORY_PAGES; n++){
+        if (loaded[n]){
+            Memory::share(n);
+        }
+    }
+
+    out << filename << "(";
+    out << Util::hex2str((WORD)start_addr);
+    out << ":";
+    out << Util::hex2str((WORD)end_addr);
+    out << ")" << std::endl;
+
+    return (true);
+}
+
+bool Memory::check_csum(const std::string &line)
+{
+    int csum;
+
+    csum = 0;
+    for (int i = 0; i < stoi(line.substr(2, 2), nullptr, 16) + 1; i++){
+        csum += stoul(line.substr(i * 2 + 2, 2), nullptr, 16);
+        csum %= 256;
+    }
+    if (csum % 256 != 255){
+        return (false);
+    }
+    return (true);
+}
+
+bool Memory::save(std::string filename, WORD start_addr, WORD end_addr)
+{
+    std::ofstream file;
+    int csum;
+    int count;
+
+    file.open(filename);
+    if (file.fail()){
+        std::cout << "OPEN ERROR!!" << filename << std::endl;
+        return (false);
+    }
+
+    // S0フィールド
+    file << "S0";
+    file << Util::hex2str_upper((BYTE)(filename.length() + 3));
+    file << "0000";
+
+    csum = filename.length() + 3;
+    for (unsigned int i = 0; i < filename.length(); i++){
+        file << Util::hex2str_upper((BYTE)filename.at(i));
+        csum += (int)filename.at(i);
+    }
+    file << Util::hex2str_upper((BYTE)((csum ^ 0x0ff) & 0x0ff));
+    file << std::endl;
+
+    // S1フィールド
+    count = 0;
+    for (int addr = start_addr; addr <= end_addr; addr++){
+        if ((addr == start_addr) || (addr % 16) == 0){
+            count++;
+            csum = 0;
+            file << "S1";
+            int bytes = 16;
+            if (addr == start_addr){
+                bytes -= start_addr;
+            }
+            if ((addr & 0xfff0) + 15 > end_addr){
+                bytes -= (15 - (end_addr % 16));
+            }
+            bytes += 3;
+            file << Util::hex2str_upper((BYTE)bytes);
+            file << Util::hex2str_upper((WORD)addr);
+
+            csum = bytes + (addr / 256) + (addr % 256);
+        }
+
+        int data = (int)Memory::read(addr);
+        file << Util::hex2str_upper((BYTE)data);
+        csum += data;
+
+        if ((addr == end_addr) || (addr % 16) == 15){
+            file << Util::hex2str_upper((BYTE)((csum ^ 0x0ff) & 0x0ff));
+            file << std::endl;
+        }
+    }
+
+    // S5フィールド
+    file << "S503";
+    file << Util::hex2str_upper((WORD)count);
+    csum = 3 + (count / 256) + (count % 256);
+    file << Util::hex2str_upper((BYTE)((csum ^ 0x0ff) & 0x0ff));
+    file << std::endl;
+
+    // S9フィールド
+    file << "S9030000FC" << std::endl;
+
+    if (file.fail()){
+        std::cout << "Write ERROR!!" << std::endl;
+        return (false);
+    }
+
+    file.close();
+
+    std::cout << filename << "(";
+    std::cout << Util::hex2str(start_addr);
+    std::cout << ":";
+    std::cout << Util::hex2str(end_addr);
+    std::cout << ")" << std::endl;
+
+    return (true);
+}
+
@@ -1,26 +1,86 @@
-#ifndef MEMORY_HPP
-#define MEMORY_HPP
-
-#include <string>
-#include <array>
-#include "common.h"
-
-class Memory {
-
-public:
-    Memory();
-    void clear();
-    void clear(BYTE data);
-    BYTE read(WORD addr);
-    void write(WORD addr, BYTE data);
-    void dump(WORD start_addr = 0, WORD end_addr = 0xffff);
-    bool load(std::string filename);
-    bool save(std::string filename, WORD start_addr = 0, WORD end_addr = 0xffff);
-
-private:
-    bool check_csum(const std::string &line);
-
-	std::array<BYTE, 64 * 1024> memory;
-};
-
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include <string>
+#include <array>
+#include <memory>
+#include <istream>
+#include <ostream>
+#include "common.h"
+
+// memory is backed by pages of the SC/MP page size (BIT_PR_PAGE)
+const int MEMORY_PAGE_SHIFT = 12;
+const int MEMORY_PAGE_SIZE = 1 << MEMORY_PAGE_SHIFT;
+const int MEMORY_PAGES = 64 * 1024 / MEMORY_PAGE_SIZE;
+
+typedef std::array<BYTE, MEMORY_PAGE_SIZE> MemoryPage;
+
+// observer of memory access (set only while needed)
+class MemoryWatch {
+public:
+    virtual ~MemoryWatch(){};
+    virtual void on_read(WORD addr, BYTE data) = 0;
+    virtual void on_fetch(WORD addr, BYTE data) = 0;    // instruction byte
+    virtual void on_write(WORD addr, BYTE data) = 0;
+};
+
+//
+// 64 KB address space in pages of three kinds:
+//   zero page     one all-zero page shared by every instance (never written)
+//   shared page   loaded image, shared by content hash with every instance
+//                 that loaded the same bytes
+//   private page  written by this instance (copy on write of the above)
+//
+// After map() every page is private and lives in a caller's region (live
+// view in shared memory): pages are never replaced, their content is.
+//
+class Memory {
+
+public:
+    Memory();
+    Memory(const Memory &other);        // private pages are copied, others shared
+    Memory &operator=(const Memory &other);
+    void fork(const Memory &base);      // share every page of base until written (base is not written meanwhile, mapped: copied)
+    void save_diff(std::ostream &file, const Memory &base);    // bytes that differ from base, as runs
+    bool load_diff(std::istream &file, const Memory &base);    // fork(base), then the runs of save_diff()
+    void clear();
+    void clear(BYTE data);
+    BYTE read(WORD addr);
+    BYTE fetch(WORD addr);
+    inline BYTE peek(WORD addr){return (page[addr >> MEMORY_PAGE_SHIFT][addr & (MEMORY_PAGE_SIZE - 1)]);};     // not watched
+    inline const BYTE *peek_page(WORD addr){return (page[addr >> MEMORY_PAGE_SHIFT]);};     // page of addr until the next change
+    void write(WORD addr, BYTE data);
+    inline void set_watch(MemoryWatch *observer){watch = observer;};
+    inline bool watched(){return (watch != nullptr);};
+    void dump(WORD start_addr = 0, WORD end_addr = 0xffff);
+    bool load(std::string filename);
+    bool load(std::istream &file, const std::string &filename, bool verbose = true);     // verbose: messages on stdout
+    bool save(std::string filename, WORD start_addr = 0, WORD end_addr = 0xffff);
+    int private_pages();
+    void map(BYTE *region);         // pages in region (64 KB) from now on, content is copied
+    inline bool mapped(){return (view != nullptr);};
+
+    // writes to addresses whose map byte has any of flags start a new generation (nullptr: none)
+    inline void set_guard(const BYTE *map, BYTE flags){guard = map; guard_flags = flags;};
+    // new at each guarded write and each change of the whole content, never used again by any instance
+    inline UINT64 generation(){return (gen);};
+
+private:
+    bool check_csum(const std::string &line);
+
+    std::shared_ptr<MemoryPage> pages[MEMORY_PAGES];
+    BYTE *page[MEMORY_PAGES];       // pages[i]->data()
+    bool owned[MEMORY_PAGES];       // private page, writable
+    MemoryWatch *watch;
+    BYTE *view;                     // region of map() (nullptr: pages on the heap)
+    const BYTE *guard;
+    BYTE guard_flags;
+    UINT64 gen;
+
+    void renew();                   // next generation
+
+    void own(int n);                // copy on write
+    void share(int n);              // replace by a shared page of the same content
+};
+
 #endif
\ No newline at end of file
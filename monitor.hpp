@@ -1,66 +1,97 @@
-#ifndef MONITOR_HPP
-#define MONITOR_HPP
-
-#include <iostream>
-#include <sstream>
-#include <string>
-#include "common.h"
-#include "memory.hpp"
-#include "cpu.hpp"
-#include "disasm.hpp"
-
-#define PREEXEC 1
-
-enum RESULT {
-    OK,
-    NG
-};
-
-enum BP_STAT {
-    BP_NONE,
-    BP_ENABLE,
-    BP_DISABLE
-};
-
-class Monitor {
-
-public:
-    Monitor(Memory& mem, CPU &cpu, Disasm &disasm);
-    void monitor();
-
-private:
-    Memory &memory;
-    CPU &cpu;
-    Disasm &disasm;
-
-    WORD BPaddr;        // Break Point memory address
-    BP_STAT BPstat;     // Break Point status
-
-    RESULT help(std::stringstream &line);
-    RESULT dump(std::stringstream &line);
-    RESULT reset(std::stringstream &line);
-    RESULT init(std::stringstream &line);
-    RESULT load(std::stringstream &line);
-    RESULT save(std::stringstream &line);
-    RESULT edit(std::stringstream &line);
-    RESULT reg(std::stringstream &line);
-    RESULT reg_sub(std::string reg_name, UINT16 reg_value, int bytes);
-    std::string reg_str();
-    std::string regSR();
-    RESULT unasm(std::stringstream &line);
-    RESULT trace(std::stringstream &line);
-    RESULT go(std::stringstream &line);
-    RESULT bp(std::stringstream &line);
-    RESULT bd(std::stringstream &line);
-    RESULT bc(std::stringstream &line);
-    RESULT be(std::stringstream &line);
-    RESULT bl(std::stringstream &line);
-
-    std::string bp_str(WORD addr);
-    bool isBP(WORD addr);
-    RESULT get_hex(std::stringstream &line, int &hex, int default_value = -1);
-    RESULT get_dec(std::stringstream &line, int &dec, int default_value = -1);
-    bool isEnd(std::stringstream &line);
-};
-
+#ifndef MONITOR_HPP
+#define MONITOR_HPP
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <atomic>
+#include "common.h"
+#include "memory.hpp"
+#include "cpu.hpp"
+#include "machine.hpp"
+#include "disasm.hpp"
+
+#define PREEXEC 1
+
+enum RESULT {
+    OK,
+    NG
+};
+
+enum BP_STAT {
+    BP_NONE,
+    BP_ENABLE,
+    BP_DISABLE
+};
+
+class Monitor {
+
+public:
+    Monitor(Machine &machine, Disasm &disasm);
+    ~Monitor();
+    void monitor();
+
+private:
+    Machine &machine;
+    Memory &memory;
+    CPU &cpu;
+    Disasm &disasm;
+
+    WORD BPaddr;        // Break Point memory address
+    BP_STAT BPstat;     // Break Point status
+
+    // G runs on a worker thread, stopped by STOP, Ctrl-C (SIGINT) or for R, D, U and PERF
+    std::thread runner;
+    std::atomic<bool> finished;     // runner is done, not joined yet
+    std::atomic<bool> pausing;      // runner is stopped for a command, not by the user
+    CPUSTAT run_status;
+    UINT64 run_end;                 // instructions count to stop at (0: none)
+    int run_stop;                   // address to stop before (-1: none)
+
+    void run();                     // body of the runner
+    void go_sub(UINT64 insts, int stop_addr);
+    void start();
+    bool pause();                   // runner stopped at a safepoint (false: it had stopped by itself)
+    void interrupt();               // runner stopped, also in a blocked GETC
+    void join();
+    inline bool running(){return (runner.joinable());};
+
+    RESULT help(std::stringstream &line);
+    RESULT dump(std::stringstream &line);
+    RESULT reset(std::stringstream &line);
+    RESULT init(std::stringstream &line);
+    RESULT load(std::stringstream &line);
+    RESULT load_basic(std::stringstream &line);
+    RESULT save(std::stringstream &line);
+    RESULT edit(std::stringstream &line);
+    RESULT reg(std::stringstream &line);
+    RESULT reg_sub(std::string reg_name, UINT16 reg_value, int bytes);
+    std::string reg_str();
+    std::string regSR();
+    std::string trace_str(WORD addr);
+    RESULT unasm(std::stringstream &line);
+    RESULT unasm_file(std::stringstream &line);
+    RESULT trace(std::stringstream &line);
+    RESULT go(std::stringstream &line);
+    RESULT go_to(std::stringstream &line);
+    RESULT go_n(std::stringstream &line);
+    RESULT step_over(std::stringstream &line);
+    RESULT finish(std::stringstream &line);
+    RESULT stop(std::stringstream &line);
+    RESULT perf(std::stringstream &line);
+    RESULT stat(std::stringstream &line);
+    RESULT bp(std::stringstream &line);
+    RESULT bd(std::stringstream &line);
+    RESULT bc(std::stringstream &line);
+    RESULT be(std::stringstream &line);
+    RESULT bl(std::stringstream &line);
+
+    std::string bp_str(WORD addr);
+    bool isBP(WORD addr);
+    RESULT get_hex(std::stringstream &line, int &hex, int default_value = -1);
+    RESULT get_dec(std::stringstream &line, int &dec, int default_value = -1);
+    bool isEnd(std::stringstream &line);
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,175 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "common.h"
+#include "util.hpp"
+#include "memory.hpp"
+#include "cpu.hpp"
+#include "disasm.hpp"
+#include "opstats.hpp"
+
+OpStats::OpStats()
+{
+    OpStats::clear();
+}
+
+void OpStats::clear()
+{
+    std::fill(&count[0], &count[256], 0);
+    std::fill(&bigram[0][0], &bigram[0][0] + 257 * 256, 0);
+    std::fill(&er_disp[0], &er_disp[256], 0);
+    prev = 256;
+}
+
+UINT64 OpStats::total()
+{
+    UINT64 sum = 0;
+
+    for (auto n : count){
+        sum += n;
+    }
+    return (sum);
+}
+
+OPMODE OpStats::mode(BYTE opcode)
+{
+    if ((opcode & BIT_SIGN_BYTE) == 0){
+        return (MODE_IMPLIED);
+    }
+    if (opcode == OPE_DLY || (opcode >= 0xc0 && (opcode & 7) == 4)){
+        return (MODE_IMMEDIATE);
+    }
+    if (opcode >= 0xc0 && (opcode & BIT_OPCODE_MODE) != 0){
+        return (MODE_AUTO_INDEXED);
+    }
+    return (((opcode & BIT_OPCODE_PR) == 0) ? MODE_PC_RELATIVE : MODE_INDEXED);
+}
+
+const char *OpStats::mode_name(OPMODE mode)
+{
+    static const char *names[MODE_COUNT] = {
+        "implied", "immediate", "pc_relative", "indexed", "auto_indexed"
+    };
+
+    return (names[mode]);
+}
+
+// opcode with pointer register, e.g. "LD @P1"
+static std::string op_name(Disasm &disasm, BYTE opcode)
+{
+    static const char *pr_name[4] = {"PC", "P1", "P2", "P3"};
+    std::string name = disasm.mnemonic(opcode);
+
+    switch (OpStats::mode(opcode)){
+    case MODE_PC_RELATIVE: name += " PC"; break;
+    case MODE_INDEXED:     name += std::string(" ") + pr_name[opcode & BIT_OPCODE_PR]; break;
+    case MODE_AUTO_INDEXED: name += std::string(" @") + pr_name[opcode & BIT_OPCODE_PR]; break;
+    default: break;
+    }
+    return (name);
+}
+
+void OpStats::report(std::ostream &out, Disasm &disasm, int top)
+{
+    UINT64 sum = OpStats::total();
+    UINT64 modes[MODE_COUNT] = {0, 0, 0, 0, 0};
+    UINT64 er = 0;
+    std::vector<std::pair<UINT64, int>> ops, pairs;
+
+    for (int op = 0; op < 256; op++){
+        modes[OpStats::mode(op)] += count[op];
+        er += er_disp[op];
+        if (count[op] != 0){
+            ops.push_back({count[op], op});
+        }
+        for (int next = 0; next < 256; next++){
+            if (bigram[op][next] != 0){
+                pairs.push_back({bigram[op][next], op * 256 + next});
+            }
+        }
+    }
+    std::sort(ops.rbegin(), ops.rend());
+    std::sort(pairs.rbegin(), pairs.rend());
+
+    out << std::fixed << std::setprecision(1);
+    out << "instructions: " << sum << std::endl;
+    for (int m = 0; m < MODE_COUNT; m++){
+        out << "  " << std::left << std::setw(13) << mode_name((OPMODE)m) << std::right << std::setw(12) << modes[m];
+        out << std::setw(7) << (sum > 0 ? 100.0 * modes[m] / sum : 0.0) << "%" << std::endl;
+    }
+    out << "  " << std::left << std::setw(13) << "er_disp" << std::right << std::setw(12) << er << std::endl;
+
+    out << "opcodes:" << std::endl;
+    for (int i = 0; i < top && i < (int)ops.size(); i++){
+        BYTE op = ops[i].second;
+        out << "  " << Util::hex2str(op) << " " << std::left << std::setw(10) << op_name(disasm, op) << std::right;
+        out << std::setw(12) << ops[i].first << std::setw(7) << 100.0 * ops[i].first / sum << "%";
+        if (er_disp[op] != 0){
+            out << "  er_disp=" << er_disp[op];
+        }
+        out << std::endl;
+    }
+
+    out << "bigrams:" << std::endl;
+    for (int i = 0; i < top && i < (int)pairs.size(); i++){
+        BYTE first = pairs[i].second >> 8;
+        BYTE second = pairs[i].second & 0xff;
+        out << "  " << Util::hex2str(first) << " " << Util::hex2str(second) << " ";
+        out << std::left << std::setw(22) << op_name(disasm, first) + " / " + op_name(disasm, second) << std::right;
+        out << std::setw(12) << pairs[i].first << std::setw(7) << 100.0 * pairs[i].first / sum << "%" << std::endl;
+    }
+}
+
+//
+// {"instructions": n, "modes": {...}, "er_disp": n,
+//  "opcodes": [{"opcode": "c5", "name": "LD @P1", "mode": "auto_indexed", "count": n, "er_disp": n}, ...],
+//  "bigrams": [{"first": "c5", "second": "ce", "count": n}, ...]}
+//
+// opcodes and bigrams that were not executed are omitted.
+//
+void OpStats::json(std::ostream &out, Disasm &disasm)
+{
+    UINT64 modes[MODE_COUNT] = {0, 0, 0, 0, 0};
+    UINT64 er = 0;
+    const char *sep;
+
+    for (int op = 0; op < 256; op++){
+        modes[OpStats::mode(op)] += count[op];
+        er += er_disp[op];
+    }
+
+    out << "{\"instructions\": " << OpStats::total() << ", \"modes\": {";
+    for (int m = 0; m < MODE_COUNT; m++){
+        out << (m == 0 ? "" : ", ") << "\"" << mode_name((OPMODE)m) << "\": " << modes[m];
+    }
+    out << "}, \"er_disp\": " << er << "," << std::endl;
+
+    out << " \"opcodes\": [";
+    sep = "";
+    for (int op = 0; op < 256; op++){
+        if (count[op] == 0){
+            continue;
+        }
+        out << sep << std::endl << "  {\"opcode\": \"" << Util::hex2str((BYTE)op) << "\", \"name\": \"" << op_name(disasm, op);
+        out << "\", \"mode\": \"" << mode_name(OpStats::mode(op)) << "\", \"count\": " << count[op];
+        out << ", \"er_disp\": " << er_disp[op] << "}";
+        sep = ",";
+    }
+    out << "]," << std::endl;
+
+    out << " \"bigrams\": [";
+    sep = "";
+    for (int op = 0; op < 256; op++){
+        for (int next = 0; next < 256; next++){
+            if (bigram[op][next] == 0){
+                continue;
+            }
+            out << sep << std::endl << "  {\"first\": \"" << Util::hex2str((BYTE)op) << "\", \"second\": \"";
+            out << Util::hex2str((BYTE)next) << "\", \"count\": " << bigram[op][next] << "}";
+            sep = ",";
+        }
+    }
+    out << "]}" << std::endl;
+}
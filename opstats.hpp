@@ -0,0 +1,50 @@
+#ifndef OPSTATS_HPP
+#define OPSTATS_HPP
+
+#include <iostream>
+#include <string>
+#include "common.h"
+
+class Disasm;
+
+// addressing mode of an opcode
+enum OPMODE {
+    MODE_IMPLIED,       // single-byte instruction
+    MODE_IMMEDIATE,     // LDI etc., DLY
+    MODE_PC_RELATIVE,   // disp(PC), jumps of PC
+    MODE_INDEXED,       // disp(Pn)
+    MODE_AUTO_INDEXED,  // @disp(Pn)
+    MODE_COUNT
+};
+
+// dynamic instruction mix: opcodes and opcode-to-opcode transitions
+class OpStats {
+public:
+    OpStats();
+    void clear();
+
+    // an instruction executed by CPU::clock()
+    inline void record(BYTE opcode, SBYTE disp){
+        count[opcode]++;
+        bigram[prev][opcode]++;
+        prev = opcode;
+        if (disp == -128 && opcode >= 0xc0 && (opcode & 7) != 4){
+            er_disp[opcode]++;      // ER as displacement (CPU::get_ea)
+        }
+    };
+
+    UINT64 total();
+    static OPMODE mode(BYTE opcode);
+    static const char *mode_name(OPMODE mode);
+
+    void report(std::ostream &out, Disasm &disasm, int top = 16);
+    void json(std::ostream &out, Disasm &disasm);
+
+private:
+    UINT64 count[256];
+    UINT64 bigram[257][256];    // [previous opcode or 256 (none)][opcode]
+    UINT64 er_disp[256];
+    int prev;
+};
+
+#endif
@@ -0,0 +1,481 @@
+//
+// ahead-of-time recompiler: S-record image to C++ blocks for aot.hpp
+//
+//   recomp.exe [-e ENTRY]... [-n NAME] [-o FILE] image.srec
+//
+// Code is discovered by recursive descent from the entries (default 0001,
+// the first instruction after reset), following jumps, fall-through, the
+// return point of XPPC and call targets set up by LDI/XPAL/LDI/XPAH.
+// Instructions with I/O, interrupt or timing effects (HALT, IEN, CAS, DLY,
+// PUTC, GETC), XPAL/XPAH of PC and undefined opcodes are left to the
+// interpreter, as is any block whose bytes have changed when it is reached
+// and the rest of a block after a store of its own into it.
+//
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "common.h"
+#include "memory.hpp"
+#include "cpu.hpp"
+#include "disasm.hpp"
+#include "aot.hpp"
+
+// how an instruction ends or continues a block
+enum InstKind {
+    STRAIGHT,       // compiled, next instruction follows
+    JUMP,           // compiled, ends the block
+    CALL,           // XPPC, ends the block
+    INTERP          // executed by the interpreter
+};
+
+struct Inst {
+    WORD addr;
+    BYTE opcode;
+    SBYTE disp;
+    int length;
+    InstKind kind;
+    std::string text;       // disassembly
+};
+
+class Recompiler {
+public:
+    Recompiler(Memory &mem, CPU &cpu);
+
+    void discover(const std::vector<WORD> &entries);
+    bool write(const std::string &filename, const std::string &name, const std::string &image);
+
+private:
+    Memory &memory;
+    Disasm disasm;
+
+    std::map<WORD, Inst> insts;     // decoded instructions
+    std::set<WORD> leaders;         // first instructions of blocks
+    std::vector<WORD> work;
+
+    void add_leader(WORD addr);
+    Inst decode(WORD addr);
+    void trace(WORD addr);
+    std::vector<Inst> block(WORD addr);
+    std::string ea_expr(const Inst &inst, bool calc);
+    std::string data_expr(const Inst &inst);
+    std::string statement(const Inst &inst);
+    bool may_store(const Inst &inst, WORD first, WORD last);
+};
+
+static std::string hexb(int n)
+{
+    char buf[8];
+    snprintf(buf, sizeof(buf), "0x%02x", n & 0xff);
+    return (buf);
+}
+
+static std::string hexw(int n)
+{
+    char buf[8];
+    snprintf(buf, sizeof(buf), "0x%04x", n & 0xffff);
+    return (buf);
+}
+
+static InstKind inst_kind(BYTE opcode, SBYTE disp)
+{
+    if (CPU::cycle_table[opcode] == 0){
+        return (INTERP);            // undefined, ST immediate
+    }
+    switch (opcode){
+    case OPE_HALT: case OPE_IEN: case OPE_CAS: case OPE_PUTC: case OPE_GETC: case OPE_DLY:
+    case OPE_XPAL: case OPE_XPAH:       // XPAL PC, XPAH PC
+        return (INTERP);
+    }
+    if ((opcode & ~BIT_OPCODE_PR) == OPE_XPPC){
+        return (CALL);
+    }
+    if (0x90 <= opcode && opcode <= 0x9f){
+        return (JUMP);
+    }
+    return (STRAIGHT);
+}
+
+Recompiler::Recompiler(Memory &mem, CPU &cpu): memory(mem), disasm(mem, cpu)
+{
+}
+
+void Recompiler::add_leader(WORD addr)
+{
+    if (leaders.insert(addr).second){
+        work.push_back(addr);
+    }
+}
+
+Inst Recompiler::decode(WORD addr)
+{
+    Inst inst;
+    std::string ea;
+
+    inst.addr = addr;
+    inst.opcode = memory.read(addr);
+    inst.length = ((inst.opcode & BIT_SIGN_BYTE) == 0) ? 1 : 2;
+    inst.disp = (inst.length == 2) ? memory.read(addr + 1) : 0;
+    inst.kind = inst_kind(inst.opcode, inst.disp);
+    if (aot_ea(addr, inst.length) != addr + inst.length){
+        inst.kind = INTERP;         // wraps around the page
+    }
+    disasm.unasm(addr, inst.text, ea);
+    if (inst.text == "UND"){
+        inst.kind = INTERP;
+    }
+    return (inst);
+}
+
+// follow straight-line code from addr, queueing the targets
+void Recompiler::trace(WORD addr)
+{
+    bool ac_known = false;
+    BYTE ac = 0;
+    int ptr_known[4] = {0, 0, 0, 0};    // bit 0: low, bit 1: high
+    WORD ptr[4] = {0, 0, 0, 0};
+
+    while (insts.find(addr) == insts.end()){
+        Inst inst = decode(addr);
+        insts[addr] = inst;
+
+        WORD next = aot_ea(addr, inst.length);
+        WORD disp_addr = aot_ea(addr, 1);
+        int pr = inst.opcode & BIT_OPCODE_PR;
+
+        if (inst.kind == INTERP){
+            if (inst.opcode != OPE_HALT && inst.text != "UND"){
+                add_leader(next);
+            }
+            return;
+        }
+        if (inst.kind == JUMP){
+            if (pr == 0){
+                add_leader(aot_ea(aot_ea(disp_addr, inst.disp), 1));
+            }
+            if ((inst.opcode & ~BIT_OPCODE_PR) != OPE_JMP){
+                add_leader(next);
+            }
+            return;
+        }
+        if (inst.kind == CALL){
+            if (pr != 0 && ptr_known[pr] == 3){
+                add_leader(aot_ea(ptr[pr], 1));
+            }
+            add_leader(next);       // return point
+            return;
+        }
+
+        // pointer values of LDI lo; XPAL Pn; LDI hi; XPAH Pn
+        int op = inst.opcode & ~BIT_OPCODE_PR;
+        if (inst.opcode == OPE_LDI){
+            ac = inst.disp;
+            ac_known = true;
+        }
+        else if (op == OPE_XPAL || op == OPE_XPAH){
+            bool high = (op == OPE_XPAH);
+            int bit = high ? 2 : 1;
+            BYTE old = high ? ptr[pr] >> 8 : ptr[pr] & 0xff;
+            bool old_known = (ptr_known[pr] & bit) != 0;
+            if (ac_known){
+                ptr[pr] = high ? (ptr[pr] & 0x00ff) | (ac << 8) : (ptr[pr] & 0xff00) | ac;
+                ptr_known[pr] |= bit;
+            }
+            else {
+                ptr_known[pr] &= ~bit;
+            }
+            ac = old;
+            ac_known = old_known;
+        }
+        else if (inst.length == 2 && (inst.opcode & BIT_OPCODE_MODE) != 0 && pr != 0){
+            ptr_known[pr] = 0;          // auto-indexed
+            ac_known = false;
+        }
+        else if (op != OPE_ST && inst.opcode != OPE_CCL && inst.opcode != OPE_SCL &&
+                 inst.opcode != OPE_NOP && inst.opcode != OPE_DINT && inst.opcode != OPE_SIO){
+            ac_known = false;
+        }
+        addr = next;
+        if (leaders.count(addr) != 0){
+            return;
+        }
+    }
+}
+
+void Recompiler::discover(const std::vector<WORD> &entries)
+{
+    for (auto entry : entries){
+        add_leader(entry);
+    }
+    while (!work.empty()){
+        WORD addr = work.back();
+        work.pop_back();
+        trace(addr);
+    }
+}
+
+// compiled instructions of the block at addr
+std::vector<Inst> Recompiler::block(WORD addr)
+{
+    std::vector<Inst> list;
+
+    for (;;){
+        auto it = insts.find(addr);
+        if (it == insts.end() || it->second.kind == INTERP){
+            break;
+        }
+        list.push_back(it->second);
+        if (it->second.kind != STRAIGHT){
+            break;
+        }
+        addr = aot_ea(addr, it->second.length);
+        if (leaders.count(addr) != 0){
+            break;
+        }
+    }
+    return (list);
+}
+
+// effective address as CPU::get_ea (calc: CPU::calc_ea of ILD/DLD)
+std::string Recompiler::ea_expr(const Inst &inst, bool calc)
+{
+    int pr = inst.opcode & BIT_OPCODE_PR;
+    bool autoidx = !calc && (inst.opcode & BIT_OPCODE_MODE) != 0;
+    WORD disp_addr = aot_ea(inst.addr, 1);
+    std::string base = (pr == 0) ? hexw(disp_addr) : "reg.PR[" + std::to_string(pr) + "]";
+    std::string disp = (!calc && inst.disp == -128) ? "(SBYTE)reg.ER" : std::to_string(inst.disp);
+
+    if (autoidx){
+        return ("aot_auto(" + base + ", " + disp + ")");
+    }
+    if (pr == 0 && (calc || inst.disp != -128)){
+        return (hexw(aot_ea(disp_addr, inst.disp)));
+    }
+    return ("aot_ea(" + base + ", " + disp + ")");
+}
+
+std::string Recompiler::data_expr(const Inst &inst)
+{
+    if ((inst.opcode & (BIT_OPCODE_MODE | BIT_OPCODE_PR)) == 4){
+        return (hexb(inst.disp));       // immediate
+    }
+    return ("memory.read(" + ea_expr(inst, false) + ")");
+}
+
+// ST, ILD or DLD whose EA can be from first to last (any address for Pn and ER)
+bool Recompiler::may_store(const Inst &inst, WORD first, WORD last)
+{
+    int op = (inst.opcode >= 0xc0) ? inst.opcode & 0xf8 : inst.opcode & 0xfc;
+    bool calc = (op == OPE_ILD || op == OPE_DLD);
+
+    if (inst.length != 2 || (op != OPE_ST && !calc)){
+        return (false);
+    }
+    if ((inst.opcode & BIT_OPCODE_PR) != 0 || (!calc && inst.disp == -128) || (!calc && (inst.opcode & BIT_OPCODE_MODE) != 0)){
+        return (true);
+    }
+    WORD ea = aot_ea(aot_ea(inst.addr, 1), inst.disp);
+
+    return (aot_inside(ea, first, last));
+}
+
+// C++ of one instruction (jumps and XPPC set PC)
+std::string Recompiler::statement(const Inst &inst)
+{
+    int pr = inst.opcode & BIT_OPCODE_PR;
+    std::string p = "reg.PR[" + std::to_string(pr) + "]";
+    std::string target = (pr == 0) ? hexw(aot_ea(aot_ea(inst.addr, 1), inst.disp)) : "aot_ea(" + p + ", " + std::to_string(inst.disp) + ")";
+    std::string taken = "reg.PR[0] = " + target + "; cycles += 2;";
+
+    if (inst.length == 2){
+        switch ((inst.opcode >= 0xc0) ? inst.opcode & 0xf8 : inst.opcode & 0xfc){
+        case OPE_JMP: return ("reg.PR[0] = " + target + ";");
+        case OPE_JP:  return ("if ((reg.AC & BIT_SIGN_BYTE) == 0){ " + taken + " }");
+        case OPE_JZ:  return ("if (reg.AC == 0){ " + taken + " }");
+        case OPE_JNZ: return ("if (reg.AC != 0){ " + taken + " }");
+        case OPE_ILD: return ("{ WORD ea = " + ea_expr(inst, true) + "; reg.AC = memory.read(ea) + 1; memory.write(ea, reg.AC); }");
+        case OPE_DLD: return ("{ WORD ea = " + ea_expr(inst, true) + "; reg.AC = memory.read(ea) - 1; memory.write(ea, reg.AC); }");
+        case OPE_LD:  return ("reg.AC = " + data_expr(inst) + ";");
+        case OPE_ST:  return ("{ WORD ea = " + ea_expr(inst, false) + "; memory.write(ea, reg.AC); }");
+        case OPE_AND: return ("reg.AC &= " + data_expr(inst) + ";");
+        case OPE_OR:  return ("reg.AC |= " + data_expr(inst) + ";");
+        case OPE_XOR: return ("reg.AC ^= " + data_expr(inst) + ";");
+        case OPE_DAD: return ("{ BYTE data = " + data_expr(inst) + "; reg.AC = aot_bcd(reg.SR, reg.AC, data); }");
+        case OPE_ADD: return ("{ BYTE data = " + data_expr(inst) + "; reg.AC = aot_add(reg.SR, reg.AC, data); }");
+        case OPE_CAD: return ("{ BYTE data = " + data_expr(inst) + "; reg.AC = aot_add(reg.SR, reg.AC, ~data); }");
+        }
+        return ("");
+    }
+
+    switch ((OPE_XPAL <= inst.opcode && inst.opcode <= OPE_XPPC + 3) ? inst.opcode & ~BIT_OPCODE_PR : inst.opcode){
+    case OPE_XAE:  return ("{ BYTE tmp = reg.AC; reg.AC = reg.ER; reg.ER = tmp; }");
+    case OPE_CCL:  return ("reg.SR &= ~BIT_SR_CY;");
+    case OPE_SCL:  return ("reg.SR |= BIT_SR_CY;");
+    case OPE_DINT: return ("reg.SR &= ~BIT_SR_IE;");
+    case OPE_CSA:  return ("reg.AC = reg.SR;");
+    case OPE_NOP:  return ("");
+    case OPE_SIO:  return ("reg.ER >>= 1;");
+    case OPE_SR:   return ("reg.AC >>= 1;");
+    case OPE_SRL:  return ("reg.AC = (reg.AC >> 1) | (reg.SR & BIT_SR_CY);");
+    case OPE_RR:   return ("reg.AC = (reg.AC >> 1) | ((reg.AC & 1) << 7);");
+    case OPE_RRL:  return ("{ BYTE lsb = reg.AC & 1; reg.AC = (reg.AC >> 1) | (reg.SR & BIT_SR_CY); reg.SR = (reg.SR & ~BIT_SR_CY) | (lsb << 7); }");
+    case OPE_XPAL: return ("{ BYTE tmp = reg.AC; reg.AC = " + p + " & 0x00ff; " + p + " = (" + p + " & 0xff00) | tmp; }");
+    case OPE_XPAH: return ("{ BYTE tmp = reg.AC; reg.AC = " + p + " >> 8; " + p + " = (" + p + " & 0x00ff) | (tmp << 8); }");
+    case OPE_XPPC: return ("reg.PR[0] = " + p + "; " + p + " = " + hexw(inst.addr) + ";");
+    case OPE_LDE:  return ("reg.AC = reg.ER;");
+    case OPE_ANE:  return ("reg.AC &= reg.ER;");
+    case OPE_ORE:  return ("reg.AC |= reg.ER;");
+    case OPE_XRE:  return ("reg.AC ^= reg.ER;");
+    case OPE_DAE:  return ("reg.AC = aot_bcd(reg.SR, reg.AC, reg.ER);");
+    case OPE_ADE:  return ("reg.AC = aot_add(reg.SR, reg.AC, reg.ER);");
+    case OPE_CAE:  return ("reg.AC = aot_add(reg.SR, reg.AC, ~reg.ER);");
+    }
+    return ("");
+}
+
+bool Recompiler::write(const std::string &filename, const std::string &name, const std::string &image)
+{
+    std::ofstream out(filename);
+    std::stringstream table;
+    int count = 0;
+
+    if (out.fail()){
+        std::cerr << "OPEN ERROR!!" << filename << std::endl;
+        return (false);
+    }
+    out << "// generated by recomp.exe from " << image << ", do not edit" << std::endl;
+    out << "#include \"common.h\"" << std::endl;
+    out << "#include \"memory.hpp\"" << std::endl;
+    out << "#include \"cpu.hpp\"" << std::endl;
+    out << "#include \"aot.hpp\"" << std::endl;
+
+    for (auto addr : leaders){
+        std::vector<Inst> list = Recompiler::block(addr);
+        if (list.empty()){
+            continue;
+        }
+
+        const Inst &last = list.back();
+        WORD end = aot_ea(last.addr, last.length - 1);
+        int length = end - addr + 1;
+        int fixed = 0;
+        int max = 0;
+
+        std::string func = "block_" + hexw(addr).substr(2);
+        out << std::endl;
+        out << "// " << hexw(addr) << "-" << hexw(end) << std::endl;
+        out << "static UINT32 " << func << "(CPURegs &reg, Memory &memory, UINT64 &cycles)" << std::endl;
+        out << "{" << std::endl;
+        out << "    static const BYTE code[" << length << "] = {";
+        for (int i = 0; i < length; i++){
+            out << (i == 0 ? "" : ", ") << hexb(memory.read(addr + i));
+        }
+        out << "};" << std::endl << std::endl;
+        out << "    if (!aot_same(memory, " << hexw(addr) << ", code, " << length << ")){" << std::endl;
+        out << "        return (0);" << std::endl;
+        out << "    }" << std::endl;
+
+        for (size_t i = 0; i < list.size(); i++){
+            const Inst &inst = list[i];
+            fixed += CPU::cycle_table[inst.opcode];
+            if (inst.kind == STRAIGHT){
+                std::string code = Recompiler::statement(inst);
+                WORD last_byte = aot_ea(inst.addr, inst.length - 1);
+                if (i + 1 < list.size() && Recompiler::may_store(inst, last_byte + 1, end)){
+                    // the rest of the block is no longer the compiled code: back to the interpreter
+                    code.insert(code.size() - 1, "if (aot_inside(ea, " + hexw(last_byte + 1) + ", " + hexw(end) + ")){ cycles += " +
+                                std::to_string(fixed) + "; reg.PR[0] = " + hexw(last_byte) + "; return (" + std::to_string(i + 1) + "); } ");
+                }
+                out << "    " << code << std::string(code.size() < 60 ? 60 - code.size() : 1, ' ');
+                out << "// " << hexw(inst.addr).substr(2) << " " << inst.text << std::endl;
+            }
+        }
+        max = fixed;
+        out << "    cycles += " << fixed << ";" << std::endl;
+        out << "    reg.PR[0] = " << hexw(end) << ";" << std::endl;
+        if (last.kind != STRAIGHT){
+            std::string code = Recompiler::statement(last);
+            out << "    " << code << std::string(code.size() < 60 ? 60 - code.size() : 1, ' ');
+            out << "// " << hexw(last.addr).substr(2) << " " << last.text << std::endl;
+            if (code.find("cycles += 2") != std::string::npos){
+                max += 2;
+            }
+        }
+        out << std::endl;
+        out << "    return (" << list.size() << ");" << std::endl;
+        out << "}" << std::endl;
+
+        table << "    {" << hexw(addr) << ", " << hexw(end) << ", " << list.size() << ", " << max << ", " << func << "}," << std::endl;
+        count++;
+    }
+
+    out << std::endl;
+    out << "static const AOTBlock blocks[] = {" << std::endl;
+    out << table.str();
+    out << "};" << std::endl;
+    out << std::endl;
+    out << "static AOTImage image(\"" << name << "\", blocks, " << count << ");" << std::endl;
+    out.close();
+
+    std::cout << filename << "(" << count << " blocks, " << insts.size() << " instructions)" << std::endl;
+
+    return (count > 0);
+}
+
+static void usage()
+{
+    std::cerr << "usage: recomp.exe [options] image.srec" << std::endl;
+    std::cerr << "  -e ENTRY     hex address of the first instruction of code (repeatable, default 0001)" << std::endl;
+    std::cerr << "  -n NAME      image name for --aot (default: file name of image)" << std::endl;
+    std::cerr << "  -o FILE      output C++ file (default: image_aot.cpp)" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<WORD> entries;
+    std::string name, output;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "e:n:o:h")) != -1){
+        switch (opt){
+        case 'e': entries.push_back(strtoul(optarg, nullptr, 16)); break;
+        case 'n': name = optarg; break;
+        case 'o': output = optarg; break;
+        default:  usage(); return (1);
+        }
+    }
+    if (optind + 1 != argc){
+        usage();
+        return (1);
+    }
+
+    std::string image = argv[optind];
+    std::string stem = image.substr(0, image.rfind('.'));
+    if (name.empty()){
+        size_t slash = stem.rfind('/');
+        name = (slash == std::string::npos) ? stem : stem.substr(slash + 1);
+    }
+    if (output.empty()){
+        output = stem + "_aot.cpp";
+    }
+    if (entries.empty()){
+        entries.push_back(0x0001);
+    }
+
+    Memory memory;
+    CPU cpu(memory);
+    if (memory.load(image) == false){
+        return (1);
+    }
+
+    Recompiler recomp(memory, cpu);
+    recomp.discover(entries);
+
+    return (recomp.write(output, name, image) ? 0 : 1);
+}
@@ -0,0 +1,45 @@
+#include <string>
+#include "common.h"
+#include "memory.hpp"
+#include "io.hpp"
+#include "cpu.hpp"
+#include "machine.hpp"
+#include "resumable.hpp"
+
+Resumable::Resumable(Machine &machine, bool yield_output): machine(machine)
+{
+    waiting = false;
+    machine.set_input(&channel);
+    machine.set_output(&channel);
+    machine.cpu.set_yield_output(yield_output);
+}
+
+Resumable::~Resumable()
+{
+    machine.cpu.set_yield_output(false);
+    machine.set_output(nullptr);
+    machine.set_input(nullptr);
+}
+
+// StringChannel ends input without waiting, so Machine::run() returns at GETC
+CPUSTAT Resumable::resume(const RunLimit &limit)
+{
+    CPUSTAT status = machine.run(limit);
+
+    waiting = (status == WAIT_INPUT);
+    return (status);
+}
+
+void Resumable::feed(const std::string &input)
+{
+    channel.feed(input);
+    waiting = false;
+}
+
+std::string Resumable::take_output()
+{
+    std::string text = channel.output();
+
+    channel.clear_output();
+    return (text);
+}
@@ -0,0 +1,46 @@
+#ifndef RESUMABLE_HPP
+#define RESUMABLE_HPP
+
+#include <string>
+#include "common.h"
+#include "memory.hpp"
+#include "io.hpp"
+#include "cpu.hpp"
+#include "machine.hpp"
+
+//
+// run of a Machine that returns instead of blocking (one host thread, many machines)
+//
+//   GETC without input stops resume() with WAIT_INPUT, PC before the GETC.
+//   After feed() the next resume() executes the GETC again. With yield_output
+//   resume() also returns YIELD after each PUTC, the character in output().
+//   Nothing is kept on the host stack between calls: the machine is the
+//   whole state of the run.
+//
+//       Resumable run(machine, true);
+//       while (1){
+//           CPUSTAT status = run.resume(limit);
+//           send(run.take_output());
+//           if (status == WAIT_INPUT) ... wait for input elsewhere, run.feed(text)
+//           else if (status != YIELD) break;
+//       }
+//
+class Resumable {
+public:
+    Resumable(Machine &machine, bool yield_output = false);
+    ~Resumable();                   // machine is back on the console
+
+    CPUSTAT resume(const RunLimit &limit);      // limit of this call
+    void feed(const std::string &input);
+    inline bool need_input(){return (waiting);};        // stopped at GETC, nothing fed since
+
+    inline const std::string &output(){return (channel.output());};
+    std::string take_output();
+
+private:
+    Machine &machine;
+    StringChannel channel;          // GETC input, PUTC output
+    bool waiting;                   // last resume() stopped at GETC
+};
+
+#endif
@@ -0,0 +1,306 @@
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <exception>
+#include "common.h"
+#include "memory.hpp"
+#include "io.hpp"
+#include "cpu.hpp"
+#include "machine.hpp"
+#include "scmp.h"
+
+// GETC and PUTC through the callbacks of scmp_set_io()
+class CallbackChannel : public IOChannel {
+public:
+    CallbackChannel(){getc_fn = nullptr; putc_fn = nullptr; user = nullptr;};
+
+    int read_char(){return (getc_fn == nullptr ? IO_EOF : getc_fn(user));};
+    void putc(BYTE c){if (putc_fn != nullptr) putc_fn(user, c);};
+    void write(const char *buf, size_t len){for (size_t i = 0; i < len; i++) CallbackChannel::putc(buf[i]);};
+
+    scmp_getc_fn getc_fn;
+    scmp_putc_fn putc_fn;
+    void *user;
+};
+
+struct scmp {
+    Machine machine;
+    CallbackChannel channel;
+};
+
+struct scmp_snapshot {
+    Memory memory;
+    BYTE AC, ER, SR;
+    WORD PC, P1, P2, P3;
+    UINT64 insts, cycles;
+};
+
+// exceptions do not cross the C API
+static int load_srec(scmp_t *m, std::istream &file)
+{
+    try {
+        return (m->machine.memory.load(file, "srec", false) ? 0: -1);
+    }
+    catch (std::exception &){
+        return (-1);
+    }
+}
+
+int scmp_version(void)
+{
+    return (SCMP_API_VERSION);
+}
+
+scmp_t *scmp_create(void)
+{
+    scmp_t *m;
+
+    try {
+        m = new scmp_t;
+    }
+    catch (std::exception &){
+        return (nullptr);
+    }
+    m->machine.set_input(&m->channel);
+    m->machine.set_output(&m->channel);
+    return (m);
+}
+
+void scmp_destroy(scmp_t *m)
+{
+    delete m;
+}
+
+int scmp_load(scmp_t *m, const char *filename)
+{
+    if (m == nullptr || filename == nullptr){
+        return (SCMP_ERROR);
+    }
+    std::ifstream file(filename);
+
+    if (!file.is_open()){
+        return (-1);
+    }
+    return (load_srec(m, file));
+}
+
+int scmp_load_srec(scmp_t *m, const char *text, size_t length)
+{
+    if (m == nullptr || text == nullptr){
+        return (SCMP_ERROR);
+    }
+    std::istringstream file(std::string(text, length));
+
+    return (load_srec(m, file));
+}
+
+void scmp_reset(scmp_t *m)
+{
+    if (m == nullptr){
+        return;
+    }
+    m->machine.cpu.reset();
+    m->machine.clear_counters();
+}
+
+scmp_status_t scmp_run(scmp_t *m, uint64_t insts, uint64_t cycles, double timeout)
+{
+    if (m == nullptr){
+        return (SCMP_ERROR);
+    }
+    RunLimit limit = {insts, cycles, timeout};
+
+    return ((scmp_status_t)m->machine.run(limit));
+}
+
+scmp_status_t scmp_step(scmp_t *m)
+{
+    if (m == nullptr){
+        return (SCMP_ERROR);
+    }
+    CPU &cpu = m->machine.cpu;
+
+    cpu.run_mode(RUN);
+    CPUSTAT status = cpu.clock();
+    m->machine.flush();
+    return ((scmp_status_t)status);
+}
+
+void scmp_request_stop(scmp_t *m)
+{
+    if (m == nullptr){
+        return;
+    }
+    m->machine.request_stop();
+}
+
+unsigned scmp_get_reg(scmp_t *m, scmp_reg_t reg)
+{
+    if (m == nullptr){
+        return ((unsigned)SCMP_ERROR);
+    }
+    CPU &cpu = m->machine.cpu;
+
+    switch (reg){
+    case SCMP_AC: return (cpu.getAC());
+    case SCMP_ER: return (cpu.getER());
+    case SCMP_SR: return (cpu.getSR());
+    case SCMP_PC: return (cpu.getPC());
+    case SCMP_P1: return (cpu.getP1());
+    case SCMP_P2: return (cpu.getP2());
+    case SCMP_P3: return (cpu.getP3());
+    }
+    return ((unsigned)SCMP_ERROR);
+}
+
+int scmp_set_reg(scmp_t *m, scmp_reg_t reg, unsigned value)
+{
+    if (m == nullptr){
+        return (SCMP_ERROR);
+    }
+    CPU &cpu = m->machine.cpu;
+
+    switch (reg){
+    case SCMP_AC: cpu.setAC(value); break;
+    case SCMP_ER: cpu.setER(value); break;
+    case SCMP_SR: cpu.setSR(value); break;
+    case SCMP_PC: cpu.setPC(value); break;
+    case SCMP_P1: cpu.setP1(value); break;
+    case SCMP_P2: cpu.setP2(value); break;
+    case SCMP_P3: cpu.setP3(value); break;
+    default:      return (SCMP_ERROR);
+    }
+    return (0);
+}
+
+uint64_t scmp_insts(scmp_t *m)
+{
+    if (m == nullptr){
+        return (0);
+    }
+    return (m->machine.cpu.get_insts());
+}
+
+uint64_t scmp_cycles(scmp_t *m)
+{
+    if (m == nullptr){
+        return (0);
+    }
+    return (m->machine.cpu.get_cycles());
+}
+
+uint8_t scmp_read(scmp_t *m, uint16_t addr)
+{
+    if (m == nullptr){
+        return (0);
+    }
+    return (m->machine.memory.peek(addr));
+}
+
+void scmp_write(scmp_t *m, uint16_t addr, uint8_t data)
+{
+    if (m == nullptr){
+        return;
+    }
+    m->machine.memory.write(addr, data);
+}
+
+void scmp_read_block(scmp_t *m, uint16_t addr, void *buf, size_t length)
+{
+    BYTE *data = (BYTE *)buf;
+
+    if (m == nullptr || data == nullptr){
+        return;
+    }
+    for (size_t i = 0; i < length; i++){
+        data[i] = m->machine.memory.peek((WORD)(addr + i));
+    }
+}
+
+void scmp_write_block(scmp_t *m, uint16_t addr, const void *buf, size_t length)
+{
+    const BYTE *data = (const BYTE *)buf;
+
+    if (m == nullptr || data == nullptr){
+        return;
+    }
+    for (size_t i = 0; i < length; i++){
+        m->machine.memory.write((WORD)(addr + i), data[i]);
+    }
+}
+
+void scmp_set_io(scmp_t *m, scmp_getc_fn getc_fn, scmp_putc_fn putc_fn, void *user)
+{
+    if (m == nullptr){
+        return;
+    }
+    m->channel.getc_fn = getc_fn;
+    m->channel.putc_fn = putc_fn;
+    m->channel.user = user;
+}
+
+void scmp_set_cooked(scmp_t *m, int flag)
+{
+    if (m == nullptr){
+        return;
+    }
+    m->channel.set_cooked(flag != 0);
+}
+
+void scmp_set_yield_output(scmp_t *m, int flag)
+{
+    if (m == nullptr){
+        return;
+    }
+    m->machine.cpu.set_yield_output(flag != 0);
+}
+
+scmp_snapshot_t *scmp_snapshot(scmp_t *m)
+{
+    scmp_snapshot_t *snapshot;
+
+    if (m == nullptr){
+        return (nullptr);
+    }
+    CPU &cpu = m->machine.cpu;
+    try {
+        snapshot = new scmp_snapshot_t{m->machine.memory};
+    }
+    catch (std::exception &){
+        return (nullptr);
+    }
+    snapshot->AC = cpu.getAC();
+    snapshot->ER = cpu.getER();
+    snapshot->SR = cpu.getSR();
+    snapshot->PC = cpu.getPC();
+    snapshot->P1 = cpu.getP1();
+    snapshot->P2 = cpu.getP2();
+    snapshot->P3 = cpu.getP3();
+    snapshot->insts = cpu.get_insts();
+    snapshot->cycles = cpu.get_cycles();
+    return (snapshot);
+}
+
+void scmp_restore(scmp_t *m, const scmp_snapshot_t *snapshot)
+{
+    if (m == nullptr || snapshot == nullptr){
+        return;
+    }
+    CPU &cpu = m->machine.cpu;
+
+    m->machine.memory = snapshot->memory;
+    cpu.setAC(snapshot->AC);
+    cpu.setER(snapshot->ER);
+    cpu.setSR(snapshot->SR);
+    cpu.setPC(snapshot->PC);
+    cpu.setP1(snapshot->P1);
+    cpu.setP2(snapshot->P2);
+    cpu.setP3(snapshot->P3);
+    m->machine.clear_counters();
+    cpu.advance(snapshot->insts, snapshot->cycles);
+}
+
+void scmp_snapshot_free(scmp_snapshot_t *snapshot)
+{
+    delete snapshot;
+}
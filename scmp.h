@@ -0,0 +1,103 @@
+#ifndef SCMP_H
+#define SCMP_H
+
+/*
+ * C API of the SC/MP emulator (libscmp.a, libscmp.so)
+ *
+ *   Each scmp_t is one machine: 64 KB memory, CPU and character I/O.
+ *   A machine is used by one thread at a time; different machines are
+ *   independent. Values of enums and the layout of functions only grow:
+ *   SCMP_API_VERSION is raised when something is added.
+ *
+ *   A NULL machine, snapshot, file name or text is a bad argument: the call
+ *   returns SCMP_ERROR (-1 of int, NULL of pointers, 0 of other values)
+ *   and changes nothing (version 3).
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SCMP_API_VERSION 3
+
+typedef struct scmp scmp_t;
+typedef struct scmp_snapshot scmp_snapshot_t;
+
+/* why scmp_run() or scmp_step() stopped (same values as CPUSTAT) */
+typedef enum {
+    SCMP_SUCCESS    = 0,    /* step executed, or the machine is still runnable */
+    SCMP_HALT       = 1,
+    SCMP_INTERRUPT  = 2,    /* step took an interrupt */
+    SCMP_UNDEFINED  = 3,    /* undefined instruction */
+    SCMP_NEED_INPUT = 4,    /* GETC found no input, PC before the GETC */
+    SCMP_BUDGET     = 5,    /* instruction or cycle limit reached */
+    SCMP_TIMEOUT    = 6,    /* wall-clock limit reached */
+    SCMP_YIELD      = 7,    /* PUTC executed while output yields */
+    SCMP_STOPPED    = 8,    /* scmp_request_stop() (version 2) */
+    SCMP_ERROR      = -1    /* bad argument (version 3) */
+} scmp_status_t;
+
+typedef enum {
+    SCMP_AC = 0,
+    SCMP_ER = 1,
+    SCMP_SR = 2,
+    SCMP_PC = 3,
+    SCMP_P1 = 4,
+    SCMP_P2 = 5,
+    SCMP_P3 = 6
+} scmp_reg_t;
+
+/* result of scmp_getc_fn when no character is returned */
+#define SCMP_EOF   (-1)     /* end of input: scmp_run() returns SCMP_NEED_INPUT */
+#define SCMP_AGAIN (-2)     /* no input yet: the same */
+
+typedef int (*scmp_getc_fn)(void *user);            /* character, SCMP_EOF or SCMP_AGAIN */
+typedef void (*scmp_putc_fn)(void *user, int c);
+
+int scmp_version(void);                             /* SCMP_API_VERSION of the library */
+
+/* machine: zero memory, reset registers, no input, output discarded */
+scmp_t *scmp_create(void);
+void scmp_destroy(scmp_t *m);
+
+/* S-record image from a file or from text (0: loaded, -1: error) */
+int scmp_load(scmp_t *m, const char *filename);
+int scmp_load_srec(scmp_t *m, const char *text, size_t length);
+
+void scmp_reset(scmp_t *m);                         /* registers and counters, memory is kept */
+
+/* run until stopped or a limit of this call is reached (0: no limit) */
+scmp_status_t scmp_run(scmp_t *m, uint64_t insts, uint64_t cycles, double timeout);
+scmp_status_t scmp_step(scmp_t *m);                 /* one instruction or interrupt */
+void scmp_request_stop(scmp_t *m);                  /* from any thread or a signal handler (version 2) */
+
+/* bad m or reg: scmp_get_reg() returns (unsigned)SCMP_ERROR, scmp_set_reg() SCMP_ERROR (version 3) */
+unsigned scmp_get_reg(scmp_t *m, scmp_reg_t reg);
+int scmp_set_reg(scmp_t *m, scmp_reg_t reg, unsigned value);   /* 0: set */
+uint64_t scmp_insts(scmp_t *m);                     /* executed since create or reset */
+uint64_t scmp_cycles(scmp_t *m);                    /* micro cycles since create or reset */
+
+/* memory access without side effects on the CPU, addresses wrap at 64 KB */
+uint8_t scmp_read(scmp_t *m, uint16_t addr);
+void scmp_write(scmp_t *m, uint16_t addr, uint8_t data);
+void scmp_read_block(scmp_t *m, uint16_t addr, void *buf, size_t length);
+void scmp_write_block(scmp_t *m, uint16_t addr, const void *buf, size_t length);
+
+/* GETC and PUTC (NULL: no input, output discarded) */
+void scmp_set_io(scmp_t *m, scmp_getc_fn getc_fn, scmp_putc_fn putc_fn, void *user);
+void scmp_set_cooked(scmp_t *m, int flag);          /* toupper() and LF->CR on input (default: on) */
+void scmp_set_yield_output(scmp_t *m, int flag);    /* scmp_run() returns SCMP_YIELD after PUTC */
+
+/* registers, counters and memory (pages not written since are shared) */
+scmp_snapshot_t *scmp_snapshot(scmp_t *m);
+void scmp_restore(scmp_t *m, const scmp_snapshot_t *snapshot);
+void scmp_snapshot_free(scmp_snapshot_t *snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
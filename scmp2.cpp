@@ -1,52 +1,663 @@
-#include <iostream>
-#include <strings.h>
-#include "common.h" 
-#include "memory.hpp"
-#include "cpu.hpp"
-#include "monitor.hpp"
-#include "disasm.hpp"
-
-void go(CPU &cpu);
-
-int main(int argc, char* argv[])
-{
-    Memory memory;
-    CPU cpu(memory);
-    Disasm disasm(memory, cpu);
-    Monitor monitor(memory, cpu, disasm);
-
-    if (argc == 1){
-        monitor.monitor();      // enter monitor
-    }
-    else if (argc == 2){
-        if (memory.load(argv[1]) == true){
-            if (strcasecmp(argv[1], "nibl.srec") == 0){
-                cpu.setSB();
-            }
-            go(cpu);            // exec
-        }
-    }
-    else {
-        std::cout << "Error" << std::endl;
-    }
-
-    return (0);
-}
-
-void go(CPU &cpu)
-{
-    CPUSTAT status;
-
-    cpu.run_mode(RUN);
-
-    do {
-        status = cpu.clock();
-    } while (status == SUCCESS);
-
-    if (status == HALT){
-        std::cout << "HALT!" << std::endl;
-    }
-    else if (status == UNDEFINED){
-        std::cout << "UNDEFINED INSTRUCTION!" << std::endl;
-    }
-}
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <strings.h>
+#include <getopt.h>
+#include <chrono>
+#include <iomanip>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <pthread.h>
+#include "common.h"
+#include "util.hpp"
+#include "memory.hpp"
+#include "io.hpp"
+#include "cpu.hpp"
+#include "machine.hpp"
+#include "monitor.hpp"
+#include "disasm.hpp"
+#include "batch.hpp"
+#include "server.hpp"
+#include "live.hpp"
+
+// process exit code
+enum EXITCODE {
+    EXIT_HALT      = 0,
+    EXIT_ERROR     = 1,     // bad option, load error
+    EXIT_UNDEFINED = 2,
+    EXIT_BUDGET    = 3,     // instruction or cycle limit
+    EXIT_TIMEOUT   = 4,
+    EXIT_NOINPUT   = 5,     // GETC at end of input
+    EXIT_STOPPED   = 6      // Ctrl-C
+};
+
+static void usage();
+static bool get_count(const char *arg, UINT64 &n);
+static bool get_seconds(const char *arg, double &sec);
+static bool in_range(const char *arg, UINT64 n, UINT64 min, UINT64 max);
+static bool preset_reg(CPU &cpu, const std::string &preset);
+static bool sweep_reg(CPU &cpu, const std::string &sweep, size_t lane);
+static bool sense_event(Machine &machine, const std::string &spec);
+static int go(Machine &machine, const RunLimit &limit, bool summary);
+static void catch_sigint(Machine &machine);
+static int go_batch(Batch &batch, const RunLimit &limit, bool summary);
+
+int main(int argc, char* argv[])
+{
+    Machine machine;
+    Disasm disasm(machine.memory, machine.cpu);
+    Monitor monitor(machine, disasm);
+
+    static const struct option options[] = {
+        {"load",         required_argument, nullptr, 'l'},
+        {"basic",        required_argument, nullptr, 'b'},
+        {"reg",          required_argument, nullptr, 'r'},
+        {"sa",           no_argument,       nullptr, 'A'},
+        {"sb",           no_argument,       nullptr, 'B'},
+        {"input",        required_argument, nullptr, 'i'},
+        {"input-string", required_argument, nullptr, 'I'},
+        {"output",       required_argument, nullptr, 'o'},
+        {"max-insts",    required_argument, nullptr, 'n'},
+        {"max-cycles",   required_argument, nullptr, 'c'},
+        {"timeout",      required_argument, nullptr, 't'},
+        {"summary",      no_argument,       nullptr, 's'},
+        {"stats",        required_argument, nullptr, 'S'},
+        {"event",        required_argument, nullptr, 'E'},
+        {"no-ffwd",      no_argument,       nullptr, 'F'},
+        {"no-fuse",      no_argument,       nullptr, 'U'},
+        {"opstats",      required_argument, nullptr, 'P'},
+        {"hle",          required_argument, nullptr, 'H'},
+        {"hle-verify",   no_argument,       nullptr, 'V'},
+        {"memo",         no_argument,       nullptr, 'M'},
+        {"memo-cache",   required_argument, nullptr, 'C'},
+        {"aot",          required_argument, nullptr, 'O'},
+        {"batch",        required_argument, nullptr, 'N'},
+        {"sweep",        required_argument, nullptr, 'W'},
+        {"serve",        required_argument, nullptr, 'K'},
+        {"pool",         required_argument, nullptr, 'L'},
+        {"hibernate",    required_argument, nullptr, 'J'},
+        {"live",         required_argument, nullptr, 'G'},
+        {"monitor",      no_argument,       nullptr, 'm'},
+        {"help",         no_argument,       nullptr, 'h'},
+        {nullptr,        0,                 nullptr, 0}
+    };
+    std::vector<std::string> images, basics, presets, sense_events, aot_images;
+    std::string input_file, output_file, input_string, hle_file, memo_file, opstats_file, sweep, serve_path, hibernate_dir, live_name;
+    bool has_input_string = false;
+    bool sa = false, sb = false, summary = false, enter_monitor = false, hle_verify = false, memo = false;
+    RunLimit limit = {0, 0, 0.0};
+    double sample = 0.0;
+    bool valid = true;
+    UINT64 lanes = 0, pool = 4;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "l:b:r:i:I:o:n:c:t:smh", options, nullptr)) != -1){
+        switch (opt){
+        case 'l': images.push_back(optarg); break;
+        case 'b': basics.push_back(optarg); break;
+        case 'r': presets.push_back(optarg); break;
+        case 'A': sa = true; break;
+        case 'B': sb = true; break;
+        case 'i': input_file = optarg; break;
+        case 'I': input_string = optarg; has_input_string = true; break;
+        case 'o': output_file = optarg; break;
+        case 'n': valid &= get_count(optarg, limit.insts); break;
+        case 'c': valid &= get_count(optarg, limit.cycles); break;
+        case 't': valid &= get_seconds(optarg, limit.timeout); break;
+        case 's': summary = true; break;
+        case 'S': valid &= get_seconds(optarg, sample); break;
+        case 'E': sense_events.push_back(optarg); break;
+        case 'F': machine.cpu.set_fast_forward(false); break;
+        case 'U': machine.cpu.set_fusion(false); break;
+        case 'P': opstats_file = optarg; machine.set_opstats(true); break;
+        case 'H': hle_file = optarg; break;
+        case 'V': hle_verify = true; break;
+        case 'M': memo = true; machine.set_memo(true); break;
+        case 'C': memo_file = optarg; break;
+        case 'O': aot_images.push_back(optarg); break;
+        case 'N': valid &= get_count(optarg, lanes) && in_range(optarg, lanes, 1, BATCH_MAX_LANES); break;
+        case 'W': sweep = optarg; break;
+        case 'K': serve_path = optarg; break;
+        case 'L': valid &= get_count(optarg, pool) && in_range(optarg, pool, 1, SERVER_MAX_POOL); break;
+        case 'J': hibernate_dir = optarg; break;
+        case 'G': live_name = optarg; break;
+        case 'm': enter_monitor = true; break;
+        case 'h': usage(); return (EXIT_HALT);
+        default:  usage(); return (EXIT_ERROR);
+        }
+    }
+    if (!valid){
+        usage();
+        return (EXIT_ERROR);
+    }
+    machine.set_sample_interval(sample);
+
+    // scmp2.exe [image [basic-file]]
+    if (optind < argc){
+        images.push_back(argv[optind]);
+        if (strcasecmp(argv[optind], "nibl.srec") == 0){
+            sb = true;
+        }
+        optind++;
+    }
+    if (optind < argc){
+        basics.push_back(argv[optind++]);
+    }
+    if (optind < argc){
+        usage();
+        return (EXIT_ERROR);
+    }
+
+    if (argc == 1){
+        catch_sigint(machine);
+        monitor.monitor();      // enter monitor
+        return (EXIT_HALT);
+    }
+
+    if (lanes > 0){
+        // lanes run by Batch, not by Machine
+        if (limit.timeout > 0 || !input_file.empty() || !output_file.empty() || !basics.empty() || !sense_events.empty() ||
+            !hle_file.empty() || memo || !memo_file.empty() || !aot_images.empty() || !opstats_file.empty() ||
+            sample > 0 || !serve_path.empty() || !live_name.empty() || enter_monitor){
+            std::cerr << "--batch does not take -t, -i, -o, -b, --event, --hle, --memo, --aot, --opstats, --stats, --serve, --live or -m" << std::endl;
+            return (EXIT_ERROR);
+        }
+        Batch batch(lanes);
+
+        for (auto &image : images){
+            if (batch.load(image) == false){
+                return (EXIT_ERROR);
+            }
+        }
+        for (size_t n = 0; n < lanes; n++){
+            CPU &cpu = batch.cpu(n);
+            for (auto &preset : presets){
+                if (preset_reg(cpu, preset) == false){
+                    std::cerr << "Bad register preset(" << preset << ")" << std::endl;
+                    return (EXIT_ERROR);
+                }
+            }
+            if (!sweep.empty() && sweep_reg(cpu, sweep, n) == false){
+                std::cerr << "Bad sweep(" << sweep << ")" << std::endl;
+                return (EXIT_ERROR);
+            }
+            if (sa){
+                cpu.setSA();
+            }
+            if (sb){
+                cpu.setSB();
+            }
+            batch.io(n).feed(input_string);
+        }
+        return (go_batch(batch, limit, summary));
+    }
+
+    for (auto &image : images){
+        if (machine.memory.load(image) == false){
+            return (EXIT_ERROR);
+        }
+    }
+    if (!hle_file.empty() && machine.load_hle(hle_file, hle_verify) == false){
+        return (EXIT_ERROR);
+    }
+    if (!memo_file.empty() && machine.load_memo(memo_file) == false){
+        return (EXIT_ERROR);
+    }
+    for (auto &name : aot_images){
+        if (machine.attach_aot(name) == false){
+            return (EXIT_ERROR);
+        }
+    }
+    for (auto &preset : presets){
+        if (preset_reg(machine.cpu, preset) == false){
+            std::cerr << "Bad register preset(" << preset << ")" << std::endl;
+            return (EXIT_ERROR);
+        }
+    }
+    for (auto &spec : sense_events){
+        if (sense_event(machine, spec) == false){
+            std::cerr << "Bad event(" << spec << ")" << std::endl;
+            return (EXIT_ERROR);
+        }
+    }
+    if (sa){
+        machine.cpu.setSA();
+    }
+    if (sb){
+        machine.cpu.setSB();
+    }
+
+    LiveView live;
+    if (!live_name.empty()){
+        if (!live.open(live_name)){
+            return (EXIT_ERROR);
+        }
+        machine.set_live(&live);
+    }
+
+    // console is replaced by files or strings
+    FileChannel file_in(input_file, "r");
+    StringChannel string_in(input_string);
+    FileChannel file_out(output_file, "w");
+
+    if (!input_file.empty()){
+        if (input_file == "-"){
+            // default console
+        }
+        else if (!file_in.is_open()){
+            std::cerr << "File not found!(" << input_file << ")" << std::endl;
+            return (EXIT_ERROR);
+        }
+        else {
+            machine.set_input(&file_in);
+        }
+    }
+    else if (has_input_string){
+        machine.set_input(&string_in);
+    }
+    if (!output_file.empty()){
+        if (!file_out.is_open()){
+            std::cerr << "OPEN ERROR!!" << output_file << std::endl;
+            return (EXIT_ERROR);
+        }
+        machine.set_output(&file_out);
+    }
+    for (auto &basic : basics){
+        if (machine.load_basic(basic) == false){
+            return (EXIT_ERROR);
+        }
+    }
+
+    catch_sigint(machine);
+    if (enter_monitor){
+        monitor.monitor();
+        return (EXIT_HALT);
+    }
+
+    if (!serve_path.empty()){
+        // golden state: booted until the program waits for input, sense events are for the jobs
+        StringChannel boot;
+        machine.clear_events();
+        machine.set_input(&boot);
+        machine.set_output(&boot);
+        CPUSTAT status = machine.run(limit);
+        machine.set_output(nullptr);
+        machine.set_input(nullptr);
+        if (status != WAIT_INPUT){
+            std::cerr << "Boot stopped without waiting for input(" << Util::hex2str(machine.cpu.getPC()) << ")" << std::endl;
+        }
+        for (auto &spec : sense_events){
+            sense_event(machine, spec);
+        }
+        Server server(machine, pool, limit);
+        server.set_hibernate_dir(hibernate_dir);
+        return (server.serve(serve_path) ? EXIT_HALT : EXIT_ERROR);
+    }
+
+    machine.set_async_output(true);
+    int code = go(machine, limit, summary);
+    machine.set_async_output(false);
+    if (!memo_file.empty() && machine.save_memo(memo_file) == false){
+        return (EXIT_ERROR);
+    }
+    if (!opstats_file.empty()){
+        std::ofstream file(opstats_file);
+        if (file.fail()){
+            std::cerr << "OPEN ERROR!!" << opstats_file << std::endl;
+            return (EXIT_ERROR);
+        }
+        machine.opstats->json(file, disasm);
+    }
+
+    return (code);
+}
+
+static void usage()
+{
+    std::cerr << "usage: scmp2.exe [options] [image.srec [program.bas]]" << std::endl;
+    std::cerr << "  -l, --load FILE          load S-record image (repeatable)" << std::endl;
+    std::cerr << "  -b, --basic FILE         BASIC program text as console input (repeatable)" << std::endl;
+    std::cerr << "  -r, --reg REG=HEX        preset AC, ER, SR, PC, P1, P2 or P3 (repeatable)" << std::endl;
+    std::cerr << "      --sa, --sb           set sense input A or B" << std::endl;
+    std::cerr << "  -i, --input FILE         GETC input from file (- : console)" << std::endl;
+    std::cerr << "  -I, --input-string STR   GETC input from string" << std::endl;
+    std::cerr << "  -o, --output FILE        PUTC output to file" << std::endl;
+    std::cerr << "  -n, --max-insts N        stop after N instructions" << std::endl;
+    std::cerr << "  -c, --max-cycles N       stop after N micro cycles" << std::endl;
+    std::cerr << "  -t, --timeout SEC        stop after SEC seconds of wall-clock time (also while GETC waits)" << std::endl;
+    std::cerr << "  -s, --summary            print one-line summary to stderr" << std::endl;
+    std::cerr << "      --stats SEC          print performance counters to stderr every SEC seconds" << std::endl;
+    std::cerr << "      --event CYCLE:SA=0|1 set sense input A or B at micro cycle CYCLE (repeatable, --serve: of each job)" << std::endl;
+    std::cerr << "      --no-ffwd            execute idle loops instead of skipping them" << std::endl;
+    std::cerr << "      --no-fuse            execute frequent opcode sequences one by one" << std::endl;
+    std::cerr << "      --opstats FILE       write opcode and bigram counts to FILE as JSON (no shortcuts)" << std::endl;
+    std::cerr << "      --hle FILE           trap routines listed in FILE to native code" << std::endl;
+    std::cerr << "      --hle-verify         run trapped routines also by the interpreter and compare" << std::endl;
+    std::cerr << "      --memo               replay recorded results of XPPC calls" << std::endl;
+    std::cerr << "      --memo-cache FILE    --memo with results loaded from and saved to FILE" << std::endl;
+    std::cerr << "      --aot NAME           run blocks of image NAME compiled by recomp.exe (all: every image)" << std::endl;
+    std::cerr << "      --batch N            run N (1-4096) instances in lockstep (-r, --sa, --sb, -I, -n and -c apply to each)" << std::endl;
+    std::cerr << "      --sweep REG=HEX      with --batch, preset REG to HEX + lane number" << std::endl;
+    std::cerr << "      --serve PATH         boot, then run jobs from Unix socket PATH on warm instances" << std::endl;
+    std::cerr << "      --pool N             with --serve, N (1-256) instances (default 4)" << std::endl;
+    std::cerr << "      --hibernate DIR      with --serve, keep sessions waiting for input in DIR" << std::endl;
+    std::cerr << "      --live NAME          run memory in /dev/shm/NAME, registers published for readers" << std::endl;
+    std::cerr << "  -m, --monitor            enter monitor after loading" << std::endl;
+    std::cerr << "exit code: 0 HALT, 1 error, 2 undefined instruction, 3 instruction/cycle limit," << std::endl;
+    std::cerr << "           4 timeout, 5 end of input, 6 stopped by Ctrl-C" << std::endl;
+}
+
+// whole argument as a number, 0x for hex (false: bad number)
+static bool get_count(const char *arg, UINT64 &n)
+{
+    char *end;
+
+    errno = 0;
+    n = strtoull(arg, &end, 0);
+    if (!isdigit((unsigned char)arg[0]) || *end != '\0' || errno != 0){
+        std::cerr << "Bad number(" << arg << ")" << std::endl;
+        return (false);
+    }
+    return (true);
+}
+
+static bool get_seconds(const char *arg, double &sec)
+{
+    char *end;
+
+    errno = 0;
+    sec = strtod(arg, &end);
+    if (!(isdigit((unsigned char)arg[0]) || arg[0] == '.') || *end != '\0' || errno != 0){
+        std::cerr << "Bad seconds(" << arg << ")" << std::endl;
+        return (false);
+    }
+    return (true);
+}
+
+static bool in_range(const char *arg, UINT64 n, UINT64 min, UINT64 max)
+{
+    if (n < min || n > max){
+        std::cerr << "Out of range(" << arg << "), " << min << " to " << max << std::endl;
+        return (false);
+    }
+    return (true);
+}
+
+static bool preset_reg(CPU &cpu, const std::string &preset)
+{
+    size_t pos = preset.find('=');
+    if (pos == std::string::npos){
+        return (false);
+    }
+    std::string name = preset.substr(0, pos);
+    std::string value = preset.substr(pos + 1);
+    char *end;
+    unsigned long data = strtoul(value.c_str(), &end, 16);
+    if (value.empty() || *end != '\0' || data > 0xffff){
+        return (false);
+    }
+
+    if (strcasecmp(name.c_str(), "AC") == 0){
+        cpu.setAC(data);
+    }
+    else if (strcasecmp(name.c_str(), "ER") == 0){
+        cpu.setER(data);
+    }
+    else if (strcasecmp(name.c_str(), "SR") == 0){
+        cpu.setSR(data);
+    }
+    else if (strcasecmp(name.c_str(), "PC") == 0){
+        cpu.setPC(data);
+    }
+    else if (strcasecmp(name.c_str(), "P1") == 0){
+        cpu.setP1(data);
+    }
+    else if (strcasecmp(name.c_str(), "P2") == 0){
+        cpu.setP2(data);
+    }
+    else if (strcasecmp(name.c_str(), "P3") == 0){
+        cpu.setP3(data);
+    }
+    else {
+        return (false);
+    }
+    return (true);
+}
+
+// REG=HEX: HEX + lane number
+static bool sweep_reg(CPU &cpu, const std::string &sweep, size_t lane)
+{
+    size_t pos = sweep.find('=');
+    if (pos == std::string::npos){
+        return (false);
+    }
+    std::string value = sweep.substr(pos + 1);
+    char *end;
+    unsigned long data = strtoul(value.c_str(), &end, 16);
+    if (value.empty() || *end != '\0' || data > 0xffff){
+        return (false);
+    }
+    return (preset_reg(cpu, sweep.substr(0, pos + 1) + Util::hex2str((WORD)(data + lane))));
+}
+
+// CYCLE:SA=1, CYCLE:SB=0
+static bool sense_event(Machine &machine, const std::string &spec)
+{
+    size_t colon = spec.find(':');
+    if (colon == std::string::npos || spec.length() != colon + 5 || spec[colon + 3] != '='){
+        return (false);
+    }
+    std::string cycle = spec.substr(0, colon);
+    std::string name = spec.substr(colon + 1, 2);
+    char level = spec[colon + 4];
+    char *end;
+    UINT64 at = strtoull(cycle.c_str(), &end, 0);
+    if (cycle.empty() || *end != '\0' || (level != '0' && level != '1')){
+        return (false);
+    }
+
+    if (strcasecmp(name.c_str(), "SA") == 0){
+        machine.schedule_sense(at, BIT_SR_SA, level == '1');
+    }
+    else if (strcasecmp(name.c_str(), "SB") == 0){
+        machine.schedule_sense(at, BIT_SR_SB, level == '1');
+    }
+    else {
+        return (false);
+    }
+    return (true);
+}
+
+// Ctrl-C stops the run at the next slice or GETC (no SA_RESTART: a blocked GETC returns)
+static Machine *sigint_machine = nullptr;
+
+static void on_sigint(int sig)
+{
+    sigint_machine->request_stop();
+}
+
+static void catch_sigint(Machine &machine)
+{
+    struct sigaction action;
+
+    sigint_machine = &machine;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_sigint;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+}
+
+static int go(Machine &machine, const RunLimit &limit, bool summary)
+{
+    CPU &cpu = machine.cpu;
+    std::string stat;
+    int code;
+
+    // a GETC blocked in a read is interrupted like Ctrl-C once the timeout passes
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool done = false;
+    std::thread watchdog;
+    pthread_t runner = pthread_self();
+
+    if (limit.timeout > 0){
+        sigset_t saved;
+        Util::block_stop_signals(&saved);
+        watchdog = std::thread([&]{
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(limit.timeout));
+            std::unique_lock<std::mutex> lock(mutex);
+
+            if (wakeup.wait_until(lock, deadline, [&]{return (done);})){
+                return;
+            }
+            // from 10 ms past the deadline (run() sees it passed), again until run() returns: the read may not have started
+            while (!wakeup.wait_for(lock, std::chrono::milliseconds(10), [&]{return (done);})){
+                machine.request_stop();
+                pthread_kill(runner, SIGINT);
+            }
+        });
+        Util::restore_signals(&saved);
+    }
+
+    CPUSTAT status = machine.run(limit);
+
+    if (watchdog.joinable()){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+        }
+        wakeup.notify_one();
+        watchdog.join();
+    }
+
+    switch (status){
+    case HALT:
+        std::cout << "HALT!" << std::endl;
+        stat = "HALT";
+        code = EXIT_HALT;
+        break;
+    case UNDEFINED:
+        std::cout << "UNDEFINED INSTRUCTION!" << std::endl;
+        stat = "UNDEFINED";
+        code = EXIT_UNDEFINED;
+        break;
+    case WAIT_INPUT:
+        std::cout << "END OF INPUT!" << std::endl;
+        stat = "NOINPUT";
+        code = EXIT_NOINPUT;
+        break;
+    case TIMEOUT:
+        stat = "TIMEOUT";
+        code = EXIT_TIMEOUT;
+        break;
+    case STOPPED:
+        std::cout << "STOPPED!" << std::endl;
+        stat = "STOPPED";
+        code = EXIT_STOPPED;
+        break;
+    default:
+        stat = "BUDGET";
+        code = EXIT_BUDGET;
+    }
+
+    if (summary){
+        std::stringstream out;
+
+        out << "status=" << stat;
+        out << " exit=" << code;
+        out << " pc=" << Util::hex2str(cpu.getPC());
+        out << " ac=" << Util::hex2str(cpu.getAC());
+        out << " er=" << Util::hex2str(cpu.getER());
+        out << " sr=" << Util::hex2str(cpu.getSR());
+        out << " p1=" << Util::hex2str(cpu.getP1());
+        out << " p2=" << Util::hex2str(cpu.getP2());
+        out << " p3=" << Util::hex2str(cpu.getP3());
+        out << " " << machine.stats_str();
+        std::cerr << out.str() << std::endl;
+    }
+
+    return (code);
+}
+
+// name and exit code of the status of a lane
+static const char *lane_stat(CPUSTAT status, int &code)
+{
+    switch (status){
+    case SUCCESS:    code = EXIT_HALT; return ("SUCCESS");
+    case HALT:       code = EXIT_HALT; return ("HALT");
+    case INTERRPT:   code = EXIT_HALT; return ("INTERRUPT");
+    case UNDEFINED:  code = EXIT_UNDEFINED; return ("UNDEFINED");
+    case WAIT_INPUT: code = EXIT_NOINPUT; return ("NOINPUT");
+    case BUDGET:     code = EXIT_BUDGET; return ("BUDGET");
+    case TIMEOUT:    code = EXIT_TIMEOUT; return ("TIMEOUT");
+    default:         code = EXIT_ERROR; return ("ERROR");
+    }
+}
+
+// every lane until it stops, output and summary by lane
+static int go_batch(Batch &batch, const RunLimit &limit, bool summary)
+{
+    UINT64 insts_limit = (limit.insts == 0) ? ~0ULL : limit.insts;
+    UINT64 cycles_limit = (limit.cycles == 0) ? ~0ULL : limit.cycles;
+    int code = EXIT_HALT;
+
+    auto start = std::chrono::steady_clock::now();
+    batch.run(insts_limit, cycles_limit);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    UINT64 insts = 0;
+    for (size_t n = 0; n < batch.size(); n++){
+        CPU &cpu = batch.cpu(n);
+        int lane_code;
+        const char *stat = lane_stat(batch.status(n), lane_code);
+
+        if (!batch.io(n).output().empty()){
+            std::cout << "lane " << n << ":" << std::endl << batch.io(n).output() << std::endl;
+        }
+        if (code == EXIT_HALT){
+            code = lane_code;               // first lane not halted
+        }
+        insts += cpu.get_insts();
+        if (summary){
+            std::stringstream out;
+
+            out << "lane=" << n;
+            out << " status=" << stat;
+            out << " exit=" << lane_code;
+            out << " pc=" << Util::hex2str(cpu.getPC());
+            out << " ac=" << Util::hex2str(cpu.getAC());
+            out << " er=" << Util::hex2str(cpu.getER());
+            out << " sr=" << Util::hex2str(cpu.getSR());
+            out << " p1=" << Util::hex2str(cpu.getP1());
+            out << " p2=" << Util::hex2str(cpu.getP2());
+            out << " p3=" << Util::hex2str(cpu.getP3());
+            out << " insts=" << cpu.get_insts();
+            out << " cycles=" << cpu.get_cycles();
+            std::cerr << out.str() << std::endl;
+        }
+    }
+    if (summary){
+        std::stringstream out;
+
+        out << std::fixed << std::setprecision(6);
+        out << "lanes=" << batch.size();
+        out << " steps=" << batch.get_steps();
+        out << " vector_insts=" << batch.get_vector_insts();
+        out << " scalar_insts=" << batch.get_scalar_insts();
+        out << " run_time=" << elapsed.count();
+        out << std::setprecision(3);
+        out << " mips=" << (elapsed.count() > 0 ? insts / elapsed.count() / 1e6 : 0.0);
+        std::cerr << out.str() << std::endl;
+    }
+
+    return (code);
+}
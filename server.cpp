@@ -0,0 +1,531 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cctype>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include "common.h"
+#include "util.hpp"
+#include "memory.hpp"
+#include "io.hpp"
+#include "cpu.hpp"
+#include "machine.hpp"
+#include "server.hpp"
+
+// largest image or input of a request
+const size_t JOB_MAX_BYTES = 1024 * 1024;
+
+// longest session ID
+const size_t SESSION_MAX_ID = 64;
+
+// seconds a client may take to send a request
+const int JOB_RECV_TIMEOUT = 10;
+
+static volatile sig_atomic_t stop_signal = 0;
+
+static void on_signal(int sig)
+{
+    stop_signal = sig;
+}
+
+// whole buffer to the client (false: client is gone)
+static bool send_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0){
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR){
+            continue;
+        }
+        if (n <= 0){
+            return (false);
+        }
+        buf += n;
+        len -= n;
+    }
+    return (true);
+}
+
+static void send_error(int fd, const std::string &status)
+{
+    std::string line = "E status=" + status + " exit=1\n";
+    send_all(fd, line.c_str(), line.length());
+}
+
+// whole value as a number (false: malformed)
+static bool get_count(const char *value, UINT64 &n, int base)
+{
+    char *end;
+
+    errno = 0;
+    n = strtoull(value, &end, base);
+    return (isdigit((unsigned char)value[0]) && *end == '\0' && errno == 0);
+}
+
+static bool get_seconds(const char *value, double &sec)
+{
+    char *end;
+
+    errno = 0;
+    sec = strtod(value, &end);
+    return ((isdigit((unsigned char)value[0]) || value[0] == '.') && *end == '\0' && errno == 0);
+}
+
+// name and exit code of scmp2.exe for the result line
+static const char *job_stat(CPUSTAT status, int &code)
+{
+    switch (status){
+    case SUCCESS:    code = 0; return ("SUCCESS");
+    case HALT:       code = 0; return ("HALT");
+    case INTERRPT:   code = 0; return ("INTERRUPT");
+    case UNDEFINED:  code = 2; return ("UNDEFINED");
+    case WAIT_INPUT: code = 5; return ("NOINPUT");
+    case BUDGET:     code = 3; return ("BUDGET");
+    case TIMEOUT:    code = 4; return ("TIMEOUT");
+    default:         code = 1; return ("ERROR");
+    }
+}
+
+// letters, digits, '-' and '_' (used as a file name)
+static bool valid_session(const std::string &id)
+{
+    if (id.empty() || id.length() > SESSION_MAX_ID){
+        return (false);
+    }
+    for (auto c : id){
+        if (!isalnum((unsigned char)c) && c != '-' && c != '_'){
+            return (false);
+        }
+    }
+    return (true);
+}
+
+//
+// FrameChannel
+//
+
+FrameChannel::FrameChannel(int fd): fd(fd)
+{
+    length = 0;
+    error = false;
+}
+
+void FrameChannel::putc(BYTE c)
+{
+    buffer[length++] = c;
+    if (length == IO_BUFSIZE || c == 0x0a){
+        FrameChannel::flush();
+    }
+}
+
+void FrameChannel::write(const char *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++){
+        FrameChannel::putc((BYTE)buf[i]);
+    }
+}
+
+void FrameChannel::flush()
+{
+    if (length == 0 || error){
+        length = 0;
+        return;
+    }
+    std::string header = "O " + std::to_string(length) + "\n";
+    error = !send_all(fd, header.c_str(), header.length()) || !send_all(fd, buffer, length);
+    length = 0;
+}
+
+//
+// Server
+//
+
+Server::Server(Machine &golden, size_t pool_size, const RunLimit &limit): golden(golden), limit(limit)
+{
+    CPU &cpu = golden.cpu;
+
+    regs.AC = cpu.getAC();
+    regs.ER = cpu.getER();
+    regs.SR = cpu.getSR();
+    regs.PC = cpu.getPC();
+    regs.P1 = cpu.getP1();
+    regs.P2 = cpu.getP2();
+    regs.P3 = cpu.getP3();
+
+    for (size_t i = 0; i < pool_size; i++){
+        pool.emplace_back(new Machine());
+        pool.back()->memory.fork(golden.memory);
+        pool.back()->copy_config(golden);
+    }
+    stop = false;
+}
+
+Server::~Server()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stop = true;
+    }
+    cv.notify_all();
+    for (auto &thread : workers){
+        thread.join();
+    }
+}
+
+bool Server::serve(const std::string &path)
+{
+    struct sockaddr_un addr;
+
+    if (path.length() >= sizeof(addr.sun_path)){
+        std::cerr << "Socket path too long!(" << path << ")" << std::endl;
+        return (false);
+    }
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0){
+        std::cerr << "socket() ERROR!!" << std::endl;
+        return (false);
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    unlink(path.c_str());
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, 64) < 0){
+        std::cerr << "Cannot listen on " << path << "(" << strerror(errno) << ")" << std::endl;
+        close(sock);
+        return (false);
+    }
+
+    // accept() returns EINTR at SIGINT or SIGTERM
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    sigset_t saved;
+    Util::block_stop_signals(&saved);          // signals interrupt accept() of this thread
+    for (auto &machine : pool){
+        workers.emplace_back(&Server::worker, this, std::ref(*machine));
+    }
+    Util::restore_signals(&saved);
+    std::cerr << "serving " << path << " (" << pool.size() << " instances)" << std::endl;
+
+    while (stop_signal == 0){
+        int fd = accept(sock, nullptr, nullptr);
+        if (fd < 0){
+            if (errno == EINTR || errno == ECONNABORTED){
+                continue;
+            }
+            std::cerr << "accept() ERROR!!(" << strerror(errno) << ")" << std::endl;
+            break;
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        queue.push_back(fd);
+        cv.notify_one();
+    }
+
+    close(sock);
+    unlink(path.c_str());
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stop = true;
+    }
+    cv.notify_all();
+    for (auto &thread : workers){
+        thread.join();
+    }
+    workers.clear();
+    for (auto fd : queue){
+        close(fd);
+    }
+    queue.clear();
+
+    return (true);
+}
+
+void Server::worker(Machine &machine)
+{
+    while (1){
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [this]{return (stop || !queue.empty());});
+            if (stop){
+                return;
+            }
+            fd = queue.front();
+            queue.pop_front();
+        }
+        Server::run_job(machine, fd);
+        close(fd);
+    }
+}
+
+// golden state: memory pages written by the last job and registers
+void Server::reset(Machine &machine)
+{
+    CPU &cpu = machine.cpu;
+
+    machine.memory.fork(golden.memory);
+    cpu.setAC(regs.AC);
+    cpu.setER(regs.ER);
+    cpu.setSR(regs.SR);
+    cpu.setPC(regs.PC);
+    cpu.setP1(regs.P1);
+    cpu.setP2(regs.P2);
+    cpu.setP3(regs.P3);
+    machine.clear_counters();
+    machine.copy_events(golden);        // cycles from the start of the job
+}
+
+void Server::run_job(Machine &machine, int fd)
+{
+    Job job;
+    std::string state;
+
+    if (!Server::read_job(fd, job)){
+        send_error(fd, "ERROR");
+        return;
+    }
+    if (!job.session.empty() && !Server::take_session(job.session, state)){
+        send_error(fd, "BUSY");
+        return;
+    }
+
+    Server::reset(machine);
+    if (!job.image.empty()){
+        std::istringstream image(job.image);
+        machine.cpu.reset();
+        if (!machine.memory.load(image, "job", false)){
+            if (!job.session.empty()){
+                Server::put_session(job.session, state);        // unchanged
+            }
+            send_error(fd, "ERROR");
+            return;
+        }
+    }
+    else if (!state.empty() && !Server::resume(machine, state)){
+        Server::put_session(job.session, "");
+        send_error(fd, "ERROR");
+        return;
+    }
+
+    StringChannel input(job.input);
+    FrameChannel output(fd);
+    machine.set_input(&input);
+    machine.set_output(&output);
+    CPUSTAT status = machine.run(job.limit);
+    machine.set_output(nullptr);
+    machine.set_input(nullptr);
+
+    std::string saved;
+    if (!job.session.empty()){
+        if (status == WAIT_INPUT){
+            saved = Server::hibernate(machine);
+        }
+        Server::put_session(job.session, saved);
+    }
+
+    if (!output.failed()){
+        CPU &cpu = machine.cpu;
+        std::stringstream result;
+        int code;
+        const char *stat = job_stat(status, code);
+        result << "E status=" << stat;
+        result << " exit=" << code;
+        result << " insts=" << cpu.get_insts();
+        result << " cycles=" << cpu.get_cycles();
+        result << " pc=" << Util::hex2str(cpu.getPC());
+        result << " ac=" << Util::hex2str(cpu.getAC());
+        if (!saved.empty()){
+            result << " saved=" << saved.length();
+        }
+        result << std::endl;
+        send_all(fd, result.str().c_str(), result.str().length());
+    }
+
+    // private pages are not kept while the instance waits in the pool
+    machine.memory.fork(golden.memory);
+}
+
+// exclusive use of a session and its hibernated state (empty: new session)
+bool Server::take_session(const std::string &id, std::string &state)
+{
+    {
+        std::lock_guard<std::mutex> lock(session_mtx);
+        if (!running.insert(id).second){
+            return (false);
+        }
+        if (hibernate_dir.empty()){
+            auto it = sessions.find(id);
+            if (it != sessions.end()){
+                state.swap(it->second);
+                sessions.erase(it);
+            }
+            return (true);
+        }
+    }
+    std::ifstream file(hibernate_dir + "/" + id + ".hib", std::ios::binary);
+    if (file.is_open()){
+        state.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    return (true);
+}
+
+void Server::put_session(const std::string &id, const std::string &state)
+{
+    if (!hibernate_dir.empty()){
+        std::string filename = hibernate_dir + "/" + id + ".hib";
+        if (state.empty()){
+            remove(filename.c_str());
+        }
+        else {
+            // a crash leaves the last complete state
+            std::ofstream file(filename + ".tmp", std::ios::binary);
+            file.write(state.data(), state.length());
+            file.close();
+            if (file.fail() || rename((filename + ".tmp").c_str(), filename.c_str()) != 0){
+                std::cerr << "Cannot save session(" << filename << ")" << std::endl;
+            }
+        }
+    }
+    std::lock_guard<std::mutex> lock(session_mtx);
+    if (hibernate_dir.empty() && !state.empty()){
+        sessions[id] = state;
+    }
+    running.erase(id);
+}
+
+// "SCH1", AC, ER, SR, PC, P1, P2, P3 (high byte first), Memory::save_diff()
+std::string Server::hibernate(Machine &machine)
+{
+    CPU &cpu = machine.cpu;
+    std::ostringstream state;
+
+    state << "SCH1";
+    state.put(cpu.getAC());
+    state.put(cpu.getER());
+    state.put(cpu.getSR());
+    for (WORD reg : {cpu.getPC(), cpu.getP1(), cpu.getP2(), cpu.getP3()}){
+        state.put(reg >> 8);
+        state.put(reg & 0xff);
+    }
+    machine.memory.save_diff(state, golden.memory);
+
+    return (state.str());
+}
+
+bool Server::resume(Machine &machine, const std::string &state)
+{
+    CPU &cpu = machine.cpu;
+    std::istringstream file(state);
+    BYTE header[15];
+
+    if (!file.read((char *)header, sizeof(header)) || memcmp(header, "SCH1", 4) != 0){
+        return (false);
+    }
+    cpu.setAC(header[4]);
+    cpu.setER(header[5]);
+    cpu.setSR(header[6]);
+    cpu.setPC((header[7] << 8) | header[8]);
+    cpu.setP1((header[9] << 8) | header[10]);
+    cpu.setP2((header[11] << 8) | header[12]);
+    cpu.setP3((header[13] << 8) | header[14]);
+
+    return (machine.memory.load_diff(file, golden.memory));
+}
+
+// header line and the bytes that follow (false: bad request)
+bool Server::read_job(int fd, Job &job)
+{
+    std::string data;
+    char buf[4096];
+    size_t eol;
+    struct timeval timeout = {JOB_RECV_TIMEOUT, 0};
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));     // recv() fails with EAGAIN
+    while ((eol = data.find('\n')) == std::string::npos){
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR){
+            continue;
+        }
+        if (n <= 0 || data.length() > 1024){
+            return (false);
+        }
+        data.append(buf, n);
+    }
+
+    std::istringstream header(data.substr(0, eol));
+    std::string word;
+    UINT64 image_len = 0, input_len = 0;
+
+    job.limit = limit;
+    header >> word;
+    if (word != "JOB"){
+        return (false);
+    }
+    while (header >> word){
+        size_t pos = word.find('=');
+        if (pos == std::string::npos){
+            return (false);
+        }
+        std::string key = word.substr(0, pos);
+        const char *value = word.c_str() + pos + 1;
+        bool valid = true;
+        if (key == "image"){
+            valid = get_count(value, image_len, 10);
+        }
+        else if (key == "input"){
+            valid = get_count(value, input_len, 10);
+        }
+        else if (key == "insts"){
+            valid = get_count(value, job.limit.insts, 0);
+        }
+        else if (key == "cycles"){
+            valid = get_count(value, job.limit.cycles, 0);
+        }
+        else if (key == "timeout"){
+            valid = get_seconds(value, job.limit.timeout);
+        }
+        else if (key == "session"){
+            job.session = value;
+            if (!valid_session(job.session)){
+                return (false);
+            }
+        }
+        else {
+            return (false);
+        }
+        if (!valid){
+            return (false);
+        }
+    }
+    if (image_len > JOB_MAX_BYTES || input_len > JOB_MAX_BYTES){
+        return (false);
+    }
+
+    data.erase(0, eol + 1);
+    while (data.length() < image_len + input_len){
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR){
+            continue;
+        }
+        if (n <= 0){
+            return (false);
+        }
+        data.append(buf, n);
+    }
+    job.image = data.substr(0, image_len);
+    job.input = data.substr(image_len, input_len);
+
+    return (true);
+}
@@ -0,0 +1,119 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "common.h"
+#include "memory.hpp"
+#include "io.hpp"
+#include "cpu.hpp"
+#include "machine.hpp"
+
+//
+// job server on a Unix-domain socket (scmp2.exe --serve PATH)
+//
+//   request:  a header line, then LEN bytes of S-record image and of input
+//       JOB [image=LEN] [input=LEN] [insts=N] [cycles=N] [timeout=SEC] [session=ID]
+//   response: output in frames as it is produced, then the result line
+//       O LEN\n<LEN bytes>
+//       E status=HALT exit=0 insts=N cycles=N pc=XXXX ac=XX [saved=BYTES]
+//
+//   Jobs run on a pool of instances in worker threads. Before each job the
+//   instance is reset to the golden state (the machine after boot): the
+//   registers are copied and only the memory pages written by the last job
+//   are shared with the golden memory again. An image in the request is
+//   loaded over the golden memory and runs from reset registers. The
+//   instances take the settings of the golden machine (fast forward,
+//   fusion, native routines, memo cache, compiled blocks), and its sense
+//   events are applied to every job with cycles from the start of the job.
+//
+//   A job of a session continues where the last job of the session stopped.
+//   A session that stops at GETC for lack of input is hibernated: the
+//   registers and the bytes that differ from the golden memory are kept in
+//   a compact form (in memory, or a file with --hibernate DIR) and the
+//   instance goes back to the pool. Sessions stopped otherwise are ended,
+//   and an image in the request starts the session again.
+//
+
+// PUTC output as frames of the response
+class FrameChannel : public IOChannel {
+public:
+    FrameChannel(int fd);
+
+    void putc(BYTE c);
+    void write(const char *buf, size_t len);
+    void flush();
+
+    inline bool failed(){return (error);};
+
+private:
+    int fd;
+    char buffer[IO_BUFSIZE];
+    size_t length;
+    bool error;             // client is gone
+};
+
+// instances of --pool
+const size_t SERVER_MAX_POOL = 256;
+
+// request of a job
+struct Job {
+    std::string image;      // S-record text (empty: golden memory)
+    std::string input;      // GETC input
+    RunLimit limit;
+    std::string session;    // ID of a session (empty: none)
+};
+
+// registers of the golden state
+struct GoldenRegs {
+    BYTE AC, ER, SR;
+    WORD PC, P1, P2, P3;
+};
+
+class Server {
+public:
+    Server(Machine &golden, size_t pool_size, const RunLimit &limit);
+    ~Server();
+
+    bool serve(const std::string &path);        // until SIGINT or SIGTERM
+    inline void set_hibernate_dir(const std::string &dir){hibernate_dir = dir;};
+
+private:
+    Machine &golden;        // not run while serving
+    GoldenRegs regs;
+    RunLimit limit;         // default of jobs
+
+    std::vector<std::unique_ptr<Machine>> pool;
+    std::vector<std::thread> workers;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<int> queue;              // accepted connections
+    std::atomic<bool> stop;
+
+    // hibernated sessions
+    std::string hibernate_dir;          // files DIR/ID.hib (empty: in memory)
+    std::mutex session_mtx;
+    std::unordered_map<std::string, std::string> sessions;
+    std::unordered_set<std::string> running;     // sessions of running jobs
+
+    void worker(Machine &machine);
+    void run_job(Machine &machine, int fd);
+    bool read_job(int fd, Job &job);
+    void reset(Machine &machine);
+
+    bool take_session(const std::string &id, std::string &state);  // false: session is running
+    void put_session(const std::string &id, const std::string &state);  // empty: end the session
+    std::string hibernate(Machine &machine);
+    bool resume(Machine &machine, const std::string &state);
+};
+
+#endif
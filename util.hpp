@@ -1,21 +1,26 @@
-#ifndef UTIL_HPP
-#define UTIL_HPP
-
-#include <string>
-#include "common.h"
-
-class Util {
-
-public:
-static std::string hex2str(BYTE n);
-static std::string hex2str(WORD n);
-static std::string hex2str_upper(BYTE n);
-static std::string hex2str_upper(WORD n);
-static std::string dec2str(BYTE n);
-static std::string dec2str(WORD n);
-
-private:
-
-};
-
+#ifndef UTIL_HPP
+#define UTIL_HPP
+
+#include <string>
+#include <csignal>
+#include "common.h"
+
+class Util {
+
+public:
+static std::string hex2str(BYTE n);
+static std::string hex2str(WORD n);
+static std::string hex2str_upper(BYTE n);
+static std::string hex2str_upper(WORD n);
+static std::string dec2str(BYTE n);
+static std::string dec2str(WORD n);
+
+// SIGINT and SIGTERM left to other threads (threads started meanwhile inherit the mask)
+static void block_stop_signals(sigset_t *saved);
+static void restore_signals(const sigset_t *saved);
+
+private:
+
+};
+
 #endif
\ No newline at end of file